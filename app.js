@@ -178,6 +178,10 @@ const core = require(path.join(__dirname, "build/Release/somhunter_core.node"));
 global.core = new core.SomHunterNapi(dataConfigFilepath);
 global.logger.log("info", "SOMHunter is ready...");
 
+// Search sessions are created on demand, destroy the abandoned ones
+const coreSessions = require("./routes/common/core_sessions");
+setInterval(() => coreSessions.destroyIdle(global.cfg.coreSessionTimeout), global.cfg.coreSessionTimeout / 4);
+
 /*
  * Push all routers into express middleware stack
  */
@@ -186,6 +190,8 @@ app.use("/", somhunterRouter);
 // SOMHunter endpoints
 app.get("/get_frame_detail_data", endpoints.getFrameDetailData);
 app.get("/get_autocomplete_results", endpoints.getAutocompleteResults);
+app.get("/get_frame_filenames", endpoints.getFrameFilenames);
+app.get("/get_stage_stats", endpoints.getStageStats);
 app.get("/get_top_screen", endpoints.getTopScreen);
 app.get("/get_som_screen", endpoints.getSomScreen);
 app.post("/submit_frame", endpoints.submitFrame);
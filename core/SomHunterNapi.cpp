@@ -20,8 +20,12 @@
  */
 #include "common.h"
 
+#include "PerfCounters.h"
 #include "SomHunterNapi.h"
+#include "StageStats.h"
+#include "Trace.h"
 
+#include <algorithm>
 #include <stdexcept>
 
 Napi::FunctionReference SomHunterNapi::constructor;
@@ -34,16 +38,40 @@ SomHunterNapi::Init(Napi::Env env, Napi::Object exports)
 	Napi::Function func = DefineClass(
 	  env,
 	  "SomHunterNapi",
-	  { InstanceMethod("getDisplay", &SomHunterNapi::get_display),
+	  { InstanceMethod("createSession", &SomHunterNapi::create_session),
+	    InstanceMethod("destroySession", &SomHunterNapi::destroy_session),
+	    InstanceMethod("getDisplay", &SomHunterNapi::get_display),
+	    InstanceMethod("getDisplayAsync",
+	                   &SomHunterNapi::get_display_async),
+	    InstanceMethod("getDisplayCompact",
+	                   &SomHunterNapi::get_display_compact),
+	    InstanceMethod("getDisplayCompactAsync",
+	                   &SomHunterNapi::get_display_compact_async),
+	    InstanceMethod("getFrameFilenames",
+	                   &SomHunterNapi::get_frame_filenames),
 	    InstanceMethod("addLikes", &SomHunterNapi::add_likes),
+	    InstanceMethod("addLikesAsync", &SomHunterNapi::add_likes_async),
 	    InstanceMethod("rescore", &SomHunterNapi::rescore),
+	    InstanceMethod("rescoreAsync", &SomHunterNapi::rescore_async),
 	    InstanceMethod("resetAll", &SomHunterNapi::reset_all),
+	    InstanceMethod("resetAllAsync", &SomHunterNapi::reset_all_async),
 	    InstanceMethod("removeLikes", &SomHunterNapi::remove_likes),
+	    InstanceMethod("removeLikesAsync",
+	                   &SomHunterNapi::remove_likes_async),
 	    InstanceMethod("autocompleteKeywords",
 	                   &SomHunterNapi::autocomplete_keywords),
 	    InstanceMethod("isSomReady", &SomHunterNapi::is_som_ready),
 	    InstanceMethod("submitToServer",
-	                   &SomHunterNapi::submit_to_server) });
+	                   &SomHunterNapi::submit_to_server),
+	    InstanceMethod("submitToServerAsync",
+	                   &SomHunterNapi::submit_to_server_async),
+	    InstanceMethod("setLogLevel", &SomHunterNapi::set_log_level),
+	    InstanceMethod("getStageStats",
+	                   &SomHunterNapi::get_stage_stats),
+	    InstanceMethod("setTracing", &SomHunterNapi::set_tracing),
+	    InstanceMethod("getTrace", &SomHunterNapi::get_trace),
+	    InstanceMethod("setPerfCounters",
+	                   &SomHunterNapi::set_perf_counters) });
 
 	constructor = Napi::Persistent(func);
 	constructor.SuppressDestruct();
@@ -72,69 +100,183 @@ SomHunterNapi::SomHunterNapi(const Napi::CallbackInfo &info)
 
 	// Parse the config
 	Config cfg = Config::parse_json_config(config_fpth);
+	Logger::get().set_level(cfg.log_level);
+	Logger::get().set_file_output(cfg.log_to_file);
 	try {
-		somhunter = new SomHunter(cfg);
+		dataset = std::make_shared<const Dataset>(cfg);
 		debug("API: SomHunter initialized.");
 	} catch (const std::exception &e) {
 		Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
 	}
 }
 
+std::shared_ptr<SearchSession>
+SomHunterNapi::get_session(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+
+	if (info.Length() < 1 || !info[0].IsString())
+		throw Napi::TypeError::New(env, "Missing search session ID");
+
+	std::string sess_ID{ info[0].As<Napi::String>().Utf8Value() };
+
+	auto it = sessions.find(sess_ID);
+	if (it == sessions.end())
+		throw Napi::Error::New(env,
+		                       "Unknown search session " + sess_ID);
+
+	return it->second;
+}
+
 Napi::Value
-SomHunterNapi::get_display(const Napi::CallbackInfo &info)
+SomHunterNapi::create_session(const Napi::CallbackInfo &info)
 {
 	Napi::Env env = info.Env();
 	Napi::HandleScope scope(env);
 
 	// Process arguments
 	int length = info.Length();
-	if (length > 4) {
+	if (length != 1) {
 		Napi::TypeError::New(env,
 		                     "Wrong number of parameters "
-		                     "(SomHunterNapi::get_display)")
+		                     "(SomHunterNapi::create_session)")
 		  .ThrowAsJavaScriptException();
 	}
 
+	std::string sess_ID{ info[0].As<Napi::String>().Utf8Value() };
+
+	bool created{ false };
+	try {
+		debug("API: CALL \n\t create_session\n\t\tsess_ID = "
+		      << sess_ID);
+
+		auto &sess = sessions[sess_ID];
+		if (!sess) {
+			sess = std::make_shared<SearchSession>(dataset);
+			created = true;
+		}
+
+		debug("API: RETURN \n\t create_session\n\t\tsessions = "
+		      << sessions.size());
+	} catch (const std::exception &e) {
+		sessions.erase(sess_ID);
+		Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+	}
+
+	napi_value result;
+	napi_get_boolean(env, created, &result);
+
+	return Napi::Object(env, result);
+}
+
+Napi::Value
+SomHunterNapi::destroy_session(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::HandleScope scope(env);
+
+	// Process arguments
+	int length = info.Length();
+	if (length != 1) {
+		Napi::TypeError::New(env,
+		                     "Wrong number of parameters "
+		                     "(SomHunterNapi::destroy_session)")
+		  .ThrowAsJavaScriptException();
+	}
+
+	std::string sess_ID{ info[0].As<Napi::String>().Utf8Value() };
+
+	debug("API: CALL \n\t destroy_session\n\t\tsess_ID = " << sess_ID);
+	bool destroyed{ sessions.erase(sess_ID) > 0 };
+
+	napi_value result;
+	napi_get_boolean(env, destroyed, &result);
+
+	return Napi::Object(env, result);
+}
+
+/** Arguments of the get_display calls */
+struct DisplayRequest
+{
+	std::string path_prefix;
 	DisplayType disp_type{ DisplayType::DTopN };
 	ImageId selected_image{ IMAGE_ID_ERR_VAL };
 	size_t page_num{ 0 };
+};
+
+/**
+ * Copy of the display, so that it can be converted to JS values after the
+ * session lock is released.
+ */
+struct DisplayResult
+{
+	std::vector<VideoFramePointer> frames;
+	std::vector<bool> liked;
+	std::vector<float> scores;
+};
+
+static DisplayRequest
+parse_display_request(const Napi::CallbackInfo &info)
+{
+	DisplayRequest req;
 
-	std::string path_prefix{ info[0].As<Napi::String>().Utf8Value() };
+	req.path_prefix = info[1].As<Napi::String>().Utf8Value();
 	// Get the display type
-	std::string display_string{ info[1].As<Napi::String>().Utf8Value() };
+	std::string display_string{ info[2].As<Napi::String>().Utf8Value() };
 	if (display_string == "topn") {
-		disp_type = DisplayType::DTopN;
-		page_num = info[2].As<Napi::Number>().Uint32Value();
+		req.disp_type = DisplayType::DTopN;
+		req.page_num = info[3].As<Napi::Number>().Uint32Value();
 
 	} else if (display_string == "som") {
-		disp_type = DisplayType::DSom;
+		req.disp_type = DisplayType::DSom;
 
 	} else if (display_string == "detail") {
-		disp_type = DisplayType::DVideoDetail;
-		selected_image = info[3].As<Napi::Number>().Uint32Value();
+		req.disp_type = DisplayType::DVideoDetail;
+		req.selected_image = info[4].As<Napi::Number>().Uint32Value();
 	} else if (display_string == "topknn") {
-		disp_type = DisplayType::DTopKNN;
-		selected_image = info[3].As<Napi::Number>().Uint32Value();
+		req.disp_type = DisplayType::DTopKNN;
+		req.selected_image = info[4].As<Napi::Number>().Uint32Value();
 	}
 
-	// Call native method
-	FramePointerRange display_frames;
-	try {
-		debug("API: CALL \n\t get_display\n\t\tdisp_type = "
-		      << int(disp_type) << std::endl
-		      << "n\t\t selected_image = " << selected_image
-		      << std::endl
-		      << "n\t\t page_num = " << page_num);
-
-		display_frames =
-		  somhunter->get_display(disp_type, selected_image, page_num);
+	return req;
+}
 
-		debug("API: RETURN \n\t get_display\n\t\tframes.size() = "
-		      << display_frames.size());
-	} catch (const std::exception &e) {
-		Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+static DisplayResult
+compute_display(SomHunter &somhunter, const DisplayRequest &req)
+{
+	debug("API: CALL \n\t get_display\n\t\tdisp_type = "
+	      << int(req.disp_type) << std::endl
+	      << "n\t\t selected_image = " << req.selected_image << std::endl
+	      << "n\t\t page_num = " << req.page_num);
+
+	FramePointerRange display_frames = somhunter.get_display(
+	  req.disp_type, req.selected_image, req.page_num);
+
+	debug("API: RETURN \n\t get_display\n\t\tframes.size() = "
+	      << display_frames.size());
+
+	DisplayResult res;
+	res.frames.assign(display_frames.begin(), display_frames.end());
+	res.liked.reserve(res.frames.size());
+	res.scores.reserve(res.frames.size());
+	for (auto &&p_frame : res.frames) {
+		res.liked.push_back(p_frame != nullptr &&
+		                    somhunter.is_liked(p_frame->frame_ID));
+		res.scores.push_back(p_frame != nullptr
+		                       ? somhunter.get_score(p_frame->frame_ID)
+		                       : 0.0f);
 	}
 
+	return res;
+}
+
+static Napi::Value
+display_to_js(Napi::Env env,
+              const DisplayRequest &req,
+              const DisplayResult &res)
+{
+	StageTimer timer(Stage::NapiMarshal);
+
 	napi_value result;
 	napi_create_object(env, &result);
 
@@ -144,13 +286,17 @@ SomHunterNapi::get_display(const Napi::CallbackInfo &info)
 		napi_create_string_utf8(env, "page", NAPI_AUTO_LENGTH, &key);
 
 		napi_value value;
-		napi_create_uint32(env, uint32_t(page_num), &value);
+		napi_create_uint32(env, uint32_t(req.page_num), &value);
 
 		napi_set_property(env, result, key, value);
 	}
 
 	// Set "frames"
 	{
+		// Reused for building the frame paths
+		std::string filename;
+		filename.reserve(req.path_prefix.size() + 64);
+
 		napi_value upperKey;
 		napi_create_string_utf8(
 		  env, "frames", NAPI_AUTO_LENGTH, &upperKey);
@@ -159,23 +305,20 @@ SomHunterNapi::get_display(const Napi::CallbackInfo &info)
 		napi_value arr;
 		napi_create_array(env, &arr);
 		{
-			size_t i{ 0_z };
-			for (auto it{ display_frames.begin() };
-			     it != display_frames.end();
-			     ++it) {
+			for (size_t i{ 0_z }; i < res.frames.size(); ++i) {
+				VideoFramePointer p_frame{ res.frames[i] };
 
 				napi_value obj;
 				napi_create_object(env, &obj);
 				{
 					ImageId ID{ IMAGE_ID_ERR_VAL };
-					bool is_liked{ false };
-					std::string filename{};
-
-					if ((*it) != nullptr) {
-						ID = (*it)->frame_ID;
-						is_liked = (*it)->liked;
-						filename =
-						  path_prefix + (*it)->filename;
+					bool is_liked{ res.liked[i] };
+					filename.clear();
+
+					if (p_frame != nullptr) {
+						ID = p_frame->frame_ID;
+						filename.append(req.path_prefix)
+						  .append(p_frame->filename);
 					}
 
 					{
@@ -228,8 +371,8 @@ SomHunterNapi::get_display(const Napi::CallbackInfo &info)
 						napi_value value;
 						napi_create_string_utf8(
 						  env,
-						  filename.c_str(),
-						  NAPI_AUTO_LENGTH,
+						  filename.data(),
+						  filename.size(),
 						  &value);
 
 						napi_set_property(
@@ -237,8 +380,6 @@ SomHunterNapi::get_display(const Napi::CallbackInfo &info)
 					}
 				}
 				napi_set_element(env, arr, i, obj);
-
-				++i;
 			}
 		}
 
@@ -248,6 +389,404 @@ SomHunterNapi::get_display(const Napi::CallbackInfo &info)
 	return Napi::Object(env, result);
 }
 
+/** ID stored in the compact display arrays for the empty places */
+constexpr uint32_t COMPACT_ID_NULL{ 0xFFFFFFFFu };
+
+/**
+ * Converts the display to an object of typed arrays `ids`, `videoIds`,
+ * `shotIds` (Uint32Array), `liked` (Uint8Array) and `scores`
+ * (Float32Array).
+ */
+static Napi::Value
+display_to_compact_js(Napi::Env env,
+                      const DisplayRequest &req,
+                      const DisplayResult &res)
+{
+	StageTimer timer(Stage::NapiMarshal);
+
+	size_t n{ res.frames.size() };
+
+	auto ids{ Napi::Uint32Array::New(env, n) };
+	auto video_IDs{ Napi::Uint32Array::New(env, n) };
+	auto shot_IDs{ Napi::Uint32Array::New(env, n) };
+	auto liked{ Napi::Uint8Array::New(env, n) };
+	auto scores{ Napi::Float32Array::New(env, n) };
+
+	uint32_t *p_ids{ ids.Data() };
+	uint32_t *p_video_IDs{ video_IDs.Data() };
+	uint32_t *p_shot_IDs{ shot_IDs.Data() };
+	uint8_t *p_liked{ liked.Data() };
+
+	for (size_t i{ 0_z }; i < n; ++i) {
+		VideoFramePointer p_frame{ res.frames[i] };
+
+		if (p_frame != nullptr) {
+			p_ids[i] = uint32_t(p_frame->frame_ID);
+			p_video_IDs[i] = uint32_t(p_frame->video_ID);
+			p_shot_IDs[i] = uint32_t(p_frame->shot_ID);
+		} else {
+			p_ids[i] = COMPACT_ID_NULL;
+			p_video_IDs[i] = COMPACT_ID_NULL;
+			p_shot_IDs[i] = COMPACT_ID_NULL;
+		}
+		p_liked[i] = res.liked[i] ? 1 : 0;
+	}
+	std::copy(res.scores.begin(), res.scores.end(), scores.Data());
+
+	auto result{ Napi::Object::New(env) };
+	result.Set("page", uint32_t(req.page_num));
+	result.Set("ids", ids);
+	result.Set("videoIds", video_IDs);
+	result.Set("shotIds", shot_IDs);
+	result.Set("liked", liked);
+	result.Set("scores", scores);
+
+	return result;
+}
+
+/** Frame IDs from the JS array */
+static std::vector<ImageId>
+frame_IDs_from_js(const Napi::Value &value)
+{
+	std::vector<ImageId> fr_IDs;
+
+	Napi::Array arr = value.As<Napi::Array>();
+	for (size_t i{ 0 }; i < arr.Length(); ++i) {
+		Napi::Value val = arr[i];
+
+		size_t fr_ID{ val.As<Napi::Number>().Uint32Value() };
+		fr_IDs.emplace_back(fr_ID);
+	}
+
+	return fr_IDs;
+}
+
+/**
+ * Runs one call of a search session on the worker thread pool and settles
+ * the returned promise with its result.
+ */
+class SessionWorker : public Napi::AsyncWorker
+{
+public:
+	SessionWorker(Napi::Env env, std::shared_ptr<SearchSession> sess)
+	  : Napi::AsyncWorker(env)
+	  , sess(std::move(sess))
+	  , deferred(Napi::Promise::Deferred::New(env))
+	{}
+
+	Napi::Promise promise() const { return deferred.Promise(); }
+
+	/**
+	 * Queues the worker after the pending calls of the session (see
+	 * `SearchSession::pending`).
+	 */
+	void start()
+	{
+		sess->pending.push_back(this);
+		if (sess->pending.size() == 1)
+			Queue();
+	}
+
+protected:
+	std::shared_ptr<SearchSession> sess;
+	Napi::Promise::Deferred deferred;
+
+	/** The work itself, called with the session locked */
+	virtual void run(SomHunter &somhunter) = 0;
+
+	/** Settles the promise after a successful `run` */
+	virtual void resolve() { deferred.Resolve(Env().Undefined()); }
+
+	void Execute() override
+	{
+		// Only the synchronous calls can hold the lock at this point
+		std::lock_guard lck{ sess->lock };
+		try {
+			run(sess->somhunter);
+		} catch (const std::exception &e) {
+			SetError(e.what());
+		}
+	}
+
+	void OnOK() override
+	{
+		start_next();
+		resolve();
+	}
+
+	void OnError(const Napi::Error &e) override
+	{
+		start_next();
+		deferred.Reject(e.Value());
+	}
+
+private:
+	void start_next()
+	{
+		sess->pending.pop_front();
+		if (!sess->pending.empty())
+			sess->pending.front()->Queue();
+	}
+};
+
+class DisplayWorker : public SessionWorker
+{
+	DisplayRequest req;
+	DisplayResult res;
+	bool compact;
+
+public:
+	DisplayWorker(Napi::Env env,
+	              std::shared_ptr<SearchSession> sess,
+	              DisplayRequest req,
+	              bool compact)
+	  : SessionWorker(env, std::move(sess))
+	  , req(std::move(req))
+	  , compact(compact)
+	{}
+
+protected:
+	void run(SomHunter &somhunter) override
+	{
+		res = compute_display(somhunter, req);
+	}
+
+	void resolve() override
+	{
+		Napi::HandleScope scope(Env());
+		if (compact)
+			deferred.Resolve(display_to_compact_js(Env(), req, res));
+		else
+			deferred.Resolve(display_to_js(Env(), req, res));
+	}
+};
+
+class RescoreWorker : public SessionWorker
+{
+	std::string query;
+
+public:
+	RescoreWorker(Napi::Env env,
+	              std::shared_ptr<SearchSession> sess,
+	              std::string query)
+	  : SessionWorker(env, std::move(sess))
+	  , query(std::move(query))
+	{}
+
+protected:
+	void run(SomHunter &somhunter) override
+	{
+		debug("API: CALL \n\t rescore_async\n\t\t query =  " << query);
+
+		somhunter.rescore(query);
+	}
+};
+
+/** Adds the likes, or removes them if `like` is false */
+class LikesWorker : public SessionWorker
+{
+	std::vector<ImageId> fr_IDs;
+	bool like;
+
+public:
+	LikesWorker(Napi::Env env,
+	            std::shared_ptr<SearchSession> sess,
+	            std::vector<ImageId> fr_IDs,
+	            bool like)
+	  : SessionWorker(env, std::move(sess))
+	  , fr_IDs(std::move(fr_IDs))
+	  , like(like)
+	{}
+
+protected:
+	void run(SomHunter &somhunter) override
+	{
+		debug("API: CALL \n\t "
+		      << (like ? "add_likes_async" : "remove_likes_async")
+		      << "\n\t\tfr_IDs.size() = " << fr_IDs.size());
+
+		if (like)
+			somhunter.add_likes(fr_IDs);
+		else
+			somhunter.remove_likes(fr_IDs);
+	}
+};
+
+class ResetWorker : public SessionWorker
+{
+public:
+	ResetWorker(Napi::Env env, std::shared_ptr<SearchSession> sess)
+	  : SessionWorker(env, std::move(sess))
+	{}
+
+protected:
+	void run(SomHunter &somhunter) override
+	{
+		debug("API: CALL \n\t reset_all_async()");
+
+		somhunter.reset_search_session();
+	}
+};
+
+class SubmitWorker : public SessionWorker
+{
+	ImageId frame_ID;
+
+public:
+	SubmitWorker(Napi::Env env,
+	             std::shared_ptr<SearchSession> sess,
+	             ImageId frame_ID)
+	  : SessionWorker(env, std::move(sess))
+	  , frame_ID(frame_ID)
+	{}
+
+protected:
+	void run(SomHunter &somhunter) override
+	{
+		debug("API: CALL \n\t submit_to_server_async\n\t\tframe_ID = "
+		      << frame_ID);
+
+		somhunter.submit_to_server(frame_ID);
+	}
+};
+
+Napi::Value
+SomHunterNapi::get_display(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::HandleScope scope(env);
+
+	// Process arguments
+	int length = info.Length();
+	if (length > 5) {
+		Napi::TypeError::New(env,
+		                     "Wrong number of parameters "
+		                     "(SomHunterNapi::get_display)")
+		  .ThrowAsJavaScriptException();
+	}
+
+	auto sess{ get_session(info) };
+	DisplayRequest req{ parse_display_request(info) };
+
+	// Call native method
+	DisplayResult res;
+	try {
+		std::lock_guard lck{ sess->lock };
+		res = compute_display(sess->somhunter, req);
+	} catch (const std::exception &e) {
+		Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+	}
+
+	return display_to_js(env, req, res);
+}
+
+Napi::Value
+SomHunterNapi::get_display_async(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::HandleScope scope(env);
+
+	// Process arguments
+	int length = info.Length();
+	if (length > 5) {
+		Napi::TypeError::New(env,
+		                     "Wrong number of parameters "
+		                     "(SomHunterNapi::get_display_async)")
+		  .ThrowAsJavaScriptException();
+	}
+
+	auto worker{ new DisplayWorker(
+	  env, get_session(info), parse_display_request(info), false) };
+	worker->start();
+
+	return worker->promise();
+}
+
+Napi::Value
+SomHunterNapi::get_display_compact(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::HandleScope scope(env);
+
+	// Process arguments
+	int length = info.Length();
+	if (length > 5) {
+		Napi::TypeError::New(env,
+		                     "Wrong number of parameters "
+		                     "(SomHunterNapi::get_display_compact)")
+		  .ThrowAsJavaScriptException();
+	}
+
+	auto sess{ get_session(info) };
+	DisplayRequest req{ parse_display_request(info) };
+
+	// Call native method
+	DisplayResult res;
+	try {
+		std::lock_guard lck{ sess->lock };
+		res = compute_display(sess->somhunter, req);
+	} catch (const std::exception &e) {
+		Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+	}
+
+	return display_to_compact_js(env, req, res);
+}
+
+Napi::Value
+SomHunterNapi::get_display_compact_async(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::HandleScope scope(env);
+
+	// Process arguments
+	int length = info.Length();
+	if (length > 5) {
+		Napi::TypeError::New(env,
+		                     "Wrong number of parameters "
+		                     "(SomHunterNapi::"
+		                     "get_display_compact_async)")
+		  .ThrowAsJavaScriptException();
+	}
+
+	auto worker{ new DisplayWorker(
+	  env, get_session(info), parse_display_request(info), true) };
+	worker->start();
+
+	return worker->promise();
+}
+
+Napi::Value
+SomHunterNapi::get_frame_filenames(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::HandleScope scope(env);
+
+	// Process arguments
+	int length = info.Length();
+	if (length != 0) {
+		Napi::TypeError::New(env,
+		                     "Wrong number of parameters "
+		                     "(SomHunterNapi::get_frame_filenames)")
+		  .ThrowAsJavaScriptException();
+	}
+
+	const DatasetFrames &frames{ dataset->frames };
+
+	napi_value arr;
+	napi_create_array_with_length(env, frames.size(), &arr);
+
+	for (ImageId i{ 0 }; i < frames.size(); ++i) {
+		std::string_view fn{ frames.filename(i) };
+
+		napi_value value;
+		napi_create_string_utf8(env, fn.data(), fn.size(), &value);
+
+		napi_set_element(env, arr, uint32_t(i), value);
+	}
+
+	return Napi::Object(env, arr);
+}
+
 Napi::Value
 SomHunterNapi::add_likes(const Napi::CallbackInfo &info)
 {
@@ -257,14 +796,18 @@ SomHunterNapi::add_likes(const Napi::CallbackInfo &info)
 	// Process arguments
 	int length = info.Length();
 
-	if (length != 1) {
+	if (length != 2) {
 		Napi::TypeError::New(env, "Wrong number of parameters")
 		  .ThrowAsJavaScriptException();
 	}
 
+	auto sess{ get_session(info) };
+	std::lock_guard lck{ sess->lock };
+	SomHunter &somhunter{ sess->somhunter };
+
 	std::vector<ImageId> fr_IDs;
 
-	Napi::Array arr = info[0].As<Napi::Array>();
+	Napi::Array arr = info[1].As<Napi::Array>();
 	for (size_t i{ 0 }; i < arr.Length(); ++i) {
 		Napi::Value val = arr[i];
 
@@ -276,7 +819,7 @@ SomHunterNapi::add_likes(const Napi::CallbackInfo &info)
 		debug("API: CALL \n\t add_likes\n\t\fr_IDs.size() = "
 		      << fr_IDs.size() << std::endl);
 
-		somhunter->add_likes(fr_IDs);
+		somhunter.add_likes(fr_IDs);
 	} catch (const std::exception &e) {
 		Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
 	}
@@ -284,6 +827,29 @@ SomHunterNapi::add_likes(const Napi::CallbackInfo &info)
 	return Napi::Object{};
 }
 
+Napi::Value
+SomHunterNapi::add_likes_async(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::HandleScope scope(env);
+
+	// Process arguments
+	int length = info.Length();
+
+	if (length != 2) {
+		Napi::TypeError::New(
+		  env,
+		  "Wrong number of parameters: SomHunterNapi::add_likes_async")
+		  .ThrowAsJavaScriptException();
+	}
+
+	auto worker{ new LikesWorker(
+	  env, get_session(info), frame_IDs_from_js(info[1]), true) };
+	worker->start();
+
+	return worker->promise();
+}
+
 Napi::Value
 SomHunterNapi::rescore(const Napi::CallbackInfo &info)
 {
@@ -293,18 +859,22 @@ SomHunterNapi::rescore(const Napi::CallbackInfo &info)
 	// Process arguments
 	int length = info.Length();
 
-	if (length != 1) {
+	if (length != 2) {
 		Napi::TypeError::New(
 		  env, "Wrong number of parameters: SomHunterNapi::rescore")
 		  .ThrowAsJavaScriptException();
 	}
-	std::string query{ info[0].As<Napi::String>().Utf8Value() };
+
+	auto sess{ get_session(info) };
+	std::lock_guard lck{ sess->lock };
+	SomHunter &somhunter{ sess->somhunter };
+	std::string query{ info[1].As<Napi::String>().Utf8Value() };
 
 	try {
 		debug("API: CALL \n\t rescore\n\t\t query =  " << query
 		                                               << std::endl);
 
-		somhunter->rescore(query);
+		somhunter.rescore(query);
 
 	} catch (const std::exception &e) {
 		Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
@@ -313,6 +883,29 @@ SomHunterNapi::rescore(const Napi::CallbackInfo &info)
 	return Napi::Object{};
 }
 
+Napi::Value
+SomHunterNapi::rescore_async(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::HandleScope scope(env);
+
+	// Process arguments
+	int length = info.Length();
+
+	if (length != 2) {
+		Napi::TypeError::New(
+		  env,
+		  "Wrong number of parameters: SomHunterNapi::rescore_async")
+		  .ThrowAsJavaScriptException();
+	}
+
+	auto worker{ new RescoreWorker(
+	  env, get_session(info), info[1].As<Napi::String>().Utf8Value()) };
+	worker->start();
+
+	return worker->promise();
+}
+
 Napi::Value
 SomHunterNapi::reset_all(const Napi::CallbackInfo &info)
 {
@@ -321,16 +914,20 @@ SomHunterNapi::reset_all(const Napi::CallbackInfo &info)
 
 	// Process arguments
 	int length = info.Length();
-	if (length != 0) {
+	if (length != 1) {
 		Napi::TypeError::New(env,
 		                     "Wrong number of parameters "
 		                     "(SomHunterNapi::reset_all)")
 		  .ThrowAsJavaScriptException();
 	}
+
+	auto sess{ get_session(info) };
+	std::lock_guard lck{ sess->lock };
+	SomHunter &somhunter{ sess->somhunter };
 	try {
 		debug("API: CALL \n\t reset_all()");
 
-		somhunter->reset_search_session();
+		somhunter.reset_search_session();
 
 	} catch (const std::exception &e) {
 		Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
@@ -339,6 +936,27 @@ SomHunterNapi::reset_all(const Napi::CallbackInfo &info)
 	return Napi::Object{};
 }
 
+Napi::Value
+SomHunterNapi::reset_all_async(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::HandleScope scope(env);
+
+	// Process arguments
+	int length = info.Length();
+	if (length != 1) {
+		Napi::TypeError::New(env,
+		                     "Wrong number of parameters "
+		                     "(SomHunterNapi::reset_all_async)")
+		  .ThrowAsJavaScriptException();
+	}
+
+	auto worker{ new ResetWorker(env, get_session(info)) };
+	worker->start();
+
+	return worker->promise();
+}
+
 Napi::Value
 SomHunterNapi::remove_likes(const Napi::CallbackInfo &info)
 {
@@ -348,13 +966,17 @@ SomHunterNapi::remove_likes(const Napi::CallbackInfo &info)
 	// Process arguments
 	int length = info.Length();
 
-	if (length != 1) {
+	if (length != 2) {
 		Napi::TypeError::New(env, "Wrong number of parameters")
 		  .ThrowAsJavaScriptException();
 	}
 
+	auto sess{ get_session(info) };
+	std::lock_guard lck{ sess->lock };
+	SomHunter &somhunter{ sess->somhunter };
+
 	std::vector<ImageId> fr_IDs;
-	Napi::Array arr = info[0].As<Napi::Array>();
+	Napi::Array arr = info[1].As<Napi::Array>();
 	for (size_t i{ 0 }; i < arr.Length(); ++i) {
 		Napi::Value val = arr[i];
 
@@ -363,10 +985,10 @@ SomHunterNapi::remove_likes(const Napi::CallbackInfo &info)
 	}
 
 	try {
-		debug("API: CALL \n\t add_likes\n\t\fr_IDs.size() = "
+		debug("API: CALL \n\t remove_likes\n\t\fr_IDs.size() = "
 		      << fr_IDs.size() << std::endl);
 
-		somhunter->add_likes(fr_IDs);
+		somhunter.remove_likes(fr_IDs);
 	} catch (const std::exception &e) {
 		Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
 	}
@@ -374,6 +996,30 @@ SomHunterNapi::remove_likes(const Napi::CallbackInfo &info)
 	return Napi::Object{};
 }
 
+Napi::Value
+SomHunterNapi::remove_likes_async(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::HandleScope scope(env);
+
+	// Process arguments
+	int length = info.Length();
+
+	if (length != 2) {
+		Napi::TypeError::New(
+		  env,
+		  "Wrong number of parameters: "
+		  "SomHunterNapi::remove_likes_async")
+		  .ThrowAsJavaScriptException();
+	}
+
+	auto worker{ new LikesWorker(
+	  env, get_session(info), frame_IDs_from_js(info[1]), false) };
+	worker->start();
+
+	return worker->promise();
+}
+
 Napi::Value
 SomHunterNapi::autocomplete_keywords(const Napi::CallbackInfo &info)
 {
@@ -383,19 +1029,24 @@ SomHunterNapi::autocomplete_keywords(const Napi::CallbackInfo &info)
 	// Process arguments
 	int length = info.Length();
 
-	if (length != 3) {
+	if (length != 4) {
 		Napi::TypeError::New(env, "Wrong number of parameters")
 		  .ThrowAsJavaScriptException();
 	}
 
-	std::string path_prefix{ info[0].As<Napi::String>().Utf8Value() };
-	std::string prefix{ info[1].As<Napi::String>().Utf8Value() };
-	size_t count{ info[2].As<Napi::Number>().Uint32Value() };
+	// No session lock: the keywords are the const ranker of the shared
+	// dataset, which no session call writes after the loading
+	auto sess{ get_session(info) };
+	const SomHunter &somhunter{ sess->somhunter };
+
+	std::string path_prefix{ info[1].As<Napi::String>().Utf8Value() };
+	std::string prefix{ info[2].As<Napi::String>().Utf8Value() };
+	size_t count{ info[3].As<Napi::Number>().Uint32Value() };
 
 	// Get suggested keywords
 	std::vector<const Keyword *> kws;
 	try {
-		kws = somhunter->autocomplete_keywords(prefix, count);
+		kws = somhunter.autocomplete_keywords(prefix, count);
 	} catch (const std::exception &e) {
 		Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
 	}
@@ -488,18 +1139,23 @@ SomHunterNapi::is_som_ready(const Napi::CallbackInfo &info)
 
 	// Process arguments
 	int length = info.Length();
-	if (length != 0) {
+	if (length != 1) {
 		Napi::TypeError::New(env,
 		                     "Wrong number of parameters "
 		                     "(SomHunterNapi::is_som_ready)")
 		  .ThrowAsJavaScriptException();
 	}
 
+	// No session lock: the ready flag is atomic and the AsyncSom lives
+	// as long as the session held here
+	auto sess{ get_session(info) };
+	const SomHunter &somhunter{ sess->somhunter };
+
 	bool is_ready{ false };
 	try {
 		debug("API: CALL \n\t som_ready()");
 
-		is_ready = somhunter->som_ready();
+		is_ready = somhunter.som_ready();
 
 		debug(
 		  "API: RETURN \n\t som_ready()\n\t\tis_ready = " << is_ready);
@@ -523,21 +1179,148 @@ SomHunterNapi::submit_to_server(const Napi::CallbackInfo &info)
 	// Process arguments
 	int length = info.Length();
 
-	if (length != 1) {
+	if (length != 2) {
 		Napi::TypeError::New(env, "Wrong number of parameters")
 		  .ThrowAsJavaScriptException();
 	}
 
-	ImageId frame_ID{ info[0].As<Napi::Number>().Uint32Value() };
+	auto sess{ get_session(info) };
+	std::lock_guard lck{ sess->lock };
+	SomHunter &somhunter{ sess->somhunter };
+
+	ImageId frame_ID{ info[1].As<Napi::Number>().Uint32Value() };
 
 	try {
 		debug("API: CALL \n\t submit_to_server\n\t\frame_ID = "
 		      << frame_ID);
 
-		somhunter->submit_to_server(frame_ID);
+		somhunter.submit_to_server(frame_ID);
 	} catch (const std::exception &e) {
 		Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
 	}
 
 	return Napi::Object{};
 }
+
+Napi::Value
+SomHunterNapi::submit_to_server_async(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::HandleScope scope(env);
+
+	// Process arguments
+	int length = info.Length();
+
+	if (length != 2) {
+		Napi::TypeError::New(env, "Wrong number of parameters")
+		  .ThrowAsJavaScriptException();
+	}
+
+	auto worker{ new SubmitWorker(
+	  env, get_session(info), info[1].As<Napi::Number>().Uint32Value()) };
+	worker->start();
+
+	return worker->promise();
+}
+
+Napi::Value
+SomHunterNapi::set_log_level(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::HandleScope scope(env);
+
+	// Process arguments
+	int length = info.Length();
+
+	if (length < 1 || length > 2) {
+		Napi::TypeError::New(env, "Wrong number of parameters")
+		  .ThrowAsJavaScriptException();
+	}
+
+	Logger::get().set_level(info[0].As<Napi::Number>().Int32Value());
+	if (length == 2)
+		Logger::get().set_file_output(
+		  info[1].As<Napi::Boolean>().Value());
+
+	return Napi::Object{};
+}
+
+Napi::Value
+SomHunterNapi::get_stage_stats(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::HandleScope scope(env);
+
+	// Process arguments
+	int length = info.Length();
+
+	if (length > 1) {
+		Napi::TypeError::New(env, "Wrong number of parameters")
+		  .ThrowAsJavaScriptException();
+	}
+
+	std::string stats{ StageStats::to_json() };
+	if (length == 1 && info[0].As<Napi::Boolean>().Value())
+		StageStats::reset();
+
+	return Napi::String::New(env, stats);
+}
+
+Napi::Value
+SomHunterNapi::set_tracing(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::HandleScope scope(env);
+
+	// Process arguments
+	int length = info.Length();
+
+	if (length != 1) {
+		Napi::TypeError::New(env, "Wrong number of parameters")
+		  .ThrowAsJavaScriptException();
+	}
+
+	Trace::enable(info[0].As<Napi::Boolean>().Value());
+
+	return Napi::Object{};
+}
+
+Napi::Value
+SomHunterNapi::get_trace(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::HandleScope scope(env);
+
+	// Process arguments
+	int length = info.Length();
+
+	if (length > 1) {
+		Napi::TypeError::New(env, "Wrong number of parameters")
+		  .ThrowAsJavaScriptException();
+	}
+
+	std::string trace{ Trace::to_json() };
+	if (length == 1 && info[0].As<Napi::Boolean>().Value())
+		Trace::clear();
+
+	return Napi::String::New(env, trace);
+}
+
+Napi::Value
+SomHunterNapi::set_perf_counters(const Napi::CallbackInfo &info)
+{
+	Napi::Env env = info.Env();
+	Napi::HandleScope scope(env);
+
+	// Process arguments
+	int length = info.Length();
+
+	if (length != 1) {
+		Napi::TypeError::New(env, "Wrong number of parameters")
+		  .ThrowAsJavaScriptException();
+	}
+
+	bool ok = PerfCounters::enable(info[0].As<Napi::Boolean>().Value());
+
+	return Napi::Boolean::New(env, ok);
+}
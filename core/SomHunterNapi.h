@@ -21,7 +21,33 @@
 #pragma once
 
 #include "SomHunter.h"
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <napi.h>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Search session together with the lock that serializes the calls coming
+ * from the JS thread and from the asynchronous workers.
+ */
+struct SearchSession
+{
+	SearchSession(std::shared_ptr<const Dataset> dataset)
+	  : somhunter(std::move(dataset))
+	{}
+
+	std::mutex lock;
+	/**
+	 * Asynchronous calls of the session in their order, the first one is
+	 * running and the next is queued when it completes, so they never
+	 * wait for each other on the thread pool. Only touched on the JS
+	 * thread.
+	 */
+	std::deque<Napi::AsyncWorker *> pending;
+	SomHunter somhunter;
+};
 
 class SomHunterNapi : public Napi::ObjectWrap<SomHunterNapi>
 {
@@ -32,21 +58,101 @@ public:
 
 private:
 	static Napi::FunctionReference constructor;
-	SomHunter *somhunter;
+
+	/** The dataset shared by all the search sessions */
+	std::shared_ptr<const Dataset> dataset;
+	/** Search sessions by their (Express) session ID */
+	std::unordered_map<std::string, std::shared_ptr<SearchSession>>
+	  sessions;
+
+	/**
+	 * Returns the search session whose ID is the first argument,
+	 * throws if there is no such session.
+	 */
+	std::shared_ptr<SearchSession> get_session(
+	  const Napi::CallbackInfo &info);
+
+	Napi::Value create_session(const Napi::CallbackInfo &info);
+
+	Napi::Value destroy_session(const Napi::CallbackInfo &info);
 
 	Napi::Value get_display(const Napi::CallbackInfo &info);
 
+	/*
+	 * The `_async` variants do the same as the synchronous ones on the
+	 * worker thread pool and return a Promise of the result.
+	 */
+	Napi::Value get_display_async(const Napi::CallbackInfo &info);
+
+	/*
+	 * Compact variants of get_display that return the display as typed
+	 * arrays (frame/video/shot IDs, liked flags and scores) instead of
+	 * an object per frame, frame paths are then resolved from the
+	 * get_frame_filenames table.
+	 */
+	Napi::Value get_display_compact(const Napi::CallbackInfo &info);
+
+	Napi::Value get_display_compact_async(const Napi::CallbackInfo &info);
+
+	/** Filenames of all frames (without the path prefix) by frame ID */
+	Napi::Value get_frame_filenames(const Napi::CallbackInfo &info);
+
 	Napi::Value add_likes(const Napi::CallbackInfo &info);
 
+	Napi::Value add_likes_async(const Napi::CallbackInfo &info);
+
 	Napi::Value remove_likes(const Napi::CallbackInfo &info);
 
+	Napi::Value remove_likes_async(const Napi::CallbackInfo &info);
+
 	Napi::Value rescore(const Napi::CallbackInfo &info);
 
+	Napi::Value rescore_async(const Napi::CallbackInfo &info);
+
 	Napi::Value reset_all(const Napi::CallbackInfo &info);
 
+	Napi::Value reset_all_async(const Napi::CallbackInfo &info);
+
+	/*
+	 * autocomplete_keywords and is_som_ready do not lock the session
+	 * (they only read the shared dataset and the SOM ready flag), so
+	 * they do not wait for the running asynchronous calls.
+	 */
+
 	Napi::Value autocomplete_keywords(const Napi::CallbackInfo &info);
 
 	Napi::Value is_som_ready(const Napi::CallbackInfo &info);
 
 	Napi::Value submit_to_server(const Napi::CallbackInfo &info);
+
+	Napi::Value submit_to_server_async(const Napi::CallbackInfo &info);
+
+	/**
+	 * Sets the runtime log level (0-3, up to LOGLEVEL) and optionally
+	 * enables/disables writing the log into GLOBAL_LOG_FILE.
+	 */
+	Napi::Value set_log_level(const Napi::CallbackInfo &info);
+
+	/**
+	 * Returns the latency statistics of the core stages as a JSON
+	 * string (see `StageStats::to_json`), the statistics are cleared
+	 * afterwards if the optional argument is true.
+	 */
+	Napi::Value get_stage_stats(const Napi::CallbackInfo &info);
+
+	/** Switches the span tracing on/off (see `Trace`) */
+	Napi::Value set_tracing(const Napi::CallbackInfo &info);
+
+	/**
+	 * Returns the recorded spans as a Chrome trace JSON string, the
+	 * spans are dropped afterwards if the optional argument is true.
+	 */
+	Napi::Value get_trace(const Napi::CallbackInfo &info);
+
+	/**
+	 * Switches the hardware counters of the scan kernels on/off (see
+	 * `PerfCounters`), returns false if they are not available on this
+	 * machine (the counting then stays off).
+	 */
+	Napi::Value set_perf_counters(const Napi::CallbackInfo &info);
 };
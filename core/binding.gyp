@@ -12,8 +12,13 @@
                 "src/DatasetFeatures.cpp",
                 "src/DatasetFrames.cpp",
                 "src/KeywordRanker.cpp",
+                "src/MappedFile.cpp",
+                "src/PerfCounters.cpp",
+                "src/ProductQuantizer.cpp",
                 "src/RelevanceScores.cpp",
+                "src/StageStats.cpp",
                 "src/Submitter.cpp",
+                "src/Trace.cpp",
             ],
             "include_dirs": [
                 "<!@(node -p \"require('node-addon-api').include\")",
@@ -47,7 +52,8 @@
                         "link_settings": {
                             "libraries": [
                                 "-L/usr/lib64/",
-                                "<!@(pkg-config libcurl --libs)"
+                                "<!@(pkg-config libcurl --libs)",
+                                "-lz"
                             ]
                         }
                     }
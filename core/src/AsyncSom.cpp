@@ -23,7 +23,10 @@
 #include "SomHunter.h"
 
 #include "SOM.h"
+#include "StageStats.h"
+#include "Trace.h"
 
+#include <optional>
 #include <random>
 
 #include "config_json.h"
@@ -36,10 +39,11 @@ AsyncSom::async_som_worker(AsyncSom *parent, const Config &cfg)
 	std::mt19937 rng(rd());
 
 	info("SOM worker starting");
+	Trace::set_thread_name("SOM worker");
 
 	while (!parent->terminate) {
 
-		std::vector<float> points;
+		const DatasetFeatures *features;
 		std::vector<float> scores;
 		size_t n;
 
@@ -54,7 +58,7 @@ AsyncSom::async_som_worker(AsyncSom *parent, const Config &cfg)
 				continue;
 			}
 
-			points.swap(parent->points);
+			features = parent->features;
 			scores.swap(parent->scores);
 			n = scores.size();
 			parent->new_data = false;
@@ -67,6 +71,9 @@ AsyncSom::async_som_worker(AsyncSom *parent, const Config &cfg)
 
 		// at this point: restart is off, input is ready.
 
+		std::optional<TraceSpan> prepare_span;
+		prepare_span.emplace("AsyncSom::prepare");
+
 		std::vector<float> nhbrdist(
 		  SOM_DISPLAY_GRID_WIDTH * SOM_DISPLAY_GRID_WIDTH *
 		  SOM_DISPLAY_GRID_HEIGHT * SOM_DISPLAY_GRID_HEIGHT);
@@ -106,40 +113,78 @@ AsyncSom::async_som_worker(AsyncSom *parent, const Config &cfg)
 			            0.1f };
 		float radiiB[2] = { negRadius * radiiA[0],
 			            negRadius * radiiA[1] };
-		som(n,
-		    SOM_DISPLAY_GRID_WIDTH * SOM_DISPLAY_GRID_HEIGHT,
-		    cfg.features_dim,
-		    SOM_ITERS,
-		    points,
-		    koho,
-		    nhbrdist,
-		    alphasA,
-		    radiiA,
-		    alphasB,
-		    radiiB,
-		    scores,
-		    rng);
+
+		// calls `f` with the feature matrix in its stored precision,
+		// the int8 and PQ codes are decoded by rows
+		auto with_points = [features](auto &&f) {
+			switch (features->get_storage()) {
+				case FeatureStorage::Fp16:
+					f(features->fv16(0));
+					break;
+				case FeatureStorage::Int8:
+				case FeatureStorage::Pq:
+					f(PointRows([features](size_t i,
+					                       float *buf) {
+						return features->row(i, buf);
+					}));
+					break;
+				default:
+					f(features->fv(0));
+			}
+		};
+
+		prepare_span.reset();
+		{
+			StageTimer timer(Stage::SomTrain);
+			with_points([&](auto points) {
+				som(n,
+				    SOM_DISPLAY_GRID_WIDTH *
+				      SOM_DISPLAY_GRID_HEIGHT,
+				    cfg.features_dim,
+				    parent->distance,
+				    SOM_ITERS,
+				    points,
+				    koho,
+				    nhbrdist,
+				    alphasA,
+				    radiiA,
+				    alphasB,
+				    radiiB,
+				    scores,
+				    rng);
+			});
+		}
 
 		if (parent->new_data || parent->terminate)
 			continue;
 		std::vector<size_t> mapping(n);
 
-		mapPointsToKohos(n,
-		                 SOM_DISPLAY_GRID_WIDTH *
-		                   SOM_DISPLAY_GRID_HEIGHT,
-		                 cfg.features_dim,
-		                 points,
-		                 koho,
-		                 mapping);
+		{
+			StageTimer timer(Stage::SomMap);
+			PerfScope perf(Stage::SomMap);
+			with_points([&](auto points) {
+				mapPointsToKohos(n,
+				                 SOM_DISPLAY_GRID_WIDTH *
+				                   SOM_DISPLAY_GRID_HEIGHT,
+				                 cfg.features_dim,
+				                 parent->distance,
+				                 points,
+				                 koho,
+				                 mapping);
+			});
+		}
 
 		if (parent->new_data || parent->terminate)
 			continue;
 
-		parent->mapping.clear();
-		parent->mapping.resize(SOM_DISPLAY_GRID_WIDTH *
-		                       SOM_DISPLAY_GRID_HEIGHT);
-		for (ImageId im = 0; im < mapping.size(); ++im)
-			parent->mapping[mapping[im]].push_back(im);
+		{
+			TraceSpan span("AsyncSom::publish");
+			parent->mapping.clear();
+			parent->mapping.resize(SOM_DISPLAY_GRID_WIDTH *
+			                       SOM_DISPLAY_GRID_HEIGHT);
+			for (ImageId im = 0; im < mapping.size(); ++im)
+				parent->mapping[mapping[im]].push_back(im);
+		}
 
 		std::atomic_thread_fence(std::memory_order_release);
 		parent->m_ready = true;
@@ -153,6 +198,7 @@ AsyncSom::async_som_worker(AsyncSom *parent, const Config &cfg)
 }
 
 AsyncSom::AsyncSom(const Config &cfg)
+  : distance(parse_som_distance(cfg.som_distance))
 {
 	new_data = m_ready = terminate = false;
 	worker = std::thread(async_som_worker, this, cfg);
@@ -171,7 +217,7 @@ void
 AsyncSom::start_work(const DatasetFeatures &fs, const ScoreModel &sc)
 {
 	std::unique_lock lck(worker_lock);
-	points = std::vector<float>(fs.fv(0), fs.fv(0) + fs.dim() * sc.size());
+	features = &fs;
 	scores = std::vector<float>(sc.v(), sc.v() + sc.size());
 	new_data = true;
 	lck.unlock();
@@ -36,6 +36,8 @@ class AsyncSom
 	std::thread worker;
 
 	size_t features_dim{};
+	/** Distance of the points and the neurons (`som_distance` config) */
+	DistKernel distance;
 
 	// worker sync
 	std::condition_variable new_data_wakeup;
@@ -51,15 +53,17 @@ class AsyncSom
 	 * terminate is set when the worker should exit.
 	 */
 	bool new_data, terminate;
-	std::vector<float> points, scores;
+	const DatasetFeatures *features{ nullptr };
+	std::vector<float> scores;
 
 	/*
 	 * Worker output protocol:
 	 *
 	 * m_ready is set when mapping is filled in AND the
-	 * memory is fenced correctly.
+	 * memory is fenced correctly. It is atomic, so it may be read
+	 * without locking the search session.
 	 */
-	bool m_ready;
+	std::atomic<bool> m_ready;
 	std::vector<std::vector<ImageId>> mapping;
 
 	static void async_som_worker(AsyncSom *parent, const Config &cfg);
@@ -68,6 +72,10 @@ public:
 	AsyncSom(const Config &cfg);
 	~AsyncSom();
 
+	/**
+	 * Starts a new SOM computation. The features are not copied, they
+	 * must stay alive until the worker terminates.
+	 */
 	void start_work(const DatasetFeatures &fs, const ScoreModel &sc);
 
 	bool map_ready() const
@@ -0,0 +1,119 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef bounded_queue_h
+#define bounded_queue_h
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+/**
+ * Bounded lock-free queue for many producers and consumers (the array-based
+ * queue by D. Vyukov). Pushing to a full queue fails instead of blocking.
+ */
+template<typename T>
+class BoundedQueue
+{
+	struct Cell
+	{
+		std::atomic<size_t> seq;
+		T data;
+	};
+
+	std::unique_ptr<Cell[]> cells;
+	size_t mask;
+
+	// Keep the positions on separate cache lines
+	alignas(64) std::atomic<size_t> enqueue_pos{ 0 };
+	alignas(64) std::atomic<size_t> dequeue_pos{ 0 };
+
+public:
+	/** The capacity is rounded up to a power of two */
+	explicit BoundedQueue(size_t capacity)
+	{
+		size_t n = 2;
+		while (n < capacity)
+			n *= 2;
+
+		cells = std::make_unique<Cell[]>(n);
+		mask = n - 1;
+		for (size_t i = 0; i < n; ++i)
+			cells[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+	BoundedQueue(const BoundedQueue &) = delete;
+	BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+	size_t capacity() const { return mask + 1; }
+
+	/** Returns false if the queue is full */
+	bool try_push(T &&val)
+	{
+		Cell *cell;
+		size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+		for (;;) {
+			cell = &cells[pos & mask];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t dif = intptr_t(seq) - intptr_t(pos);
+
+			if (dif == 0) {
+				if (enqueue_pos.compare_exchange_weak(
+				      pos, pos + 1, std::memory_order_relaxed))
+					break;
+			} else if (dif < 0)
+				return false;
+			else
+				pos = enqueue_pos.load(std::memory_order_relaxed);
+		}
+
+		cell->data = std::move(val);
+		cell->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Returns false if the queue is empty */
+	bool try_pop(T &val)
+	{
+		Cell *cell;
+		size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+		for (;;) {
+			cell = &cells[pos & mask];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t dif = intptr_t(seq) - intptr_t(pos + 1);
+
+			if (dif == 0) {
+				if (dequeue_pos.compare_exchange_weak(
+				      pos, pos + 1, std::memory_order_relaxed))
+					break;
+			} else if (dif < 0)
+				return false;
+			else
+				pos = dequeue_pos.load(std::memory_order_relaxed);
+		}
+
+		val = std::move(cell->data);
+		cell->seq.store(pos + mask + 1, std::memory_order_release);
+		return true;
+	}
+};
+
+#endif
@@ -0,0 +1,56 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef dataset_h
+#define dataset_h
+
+#include "DatasetFeatures.h"
+#include "DatasetFrames.h"
+#include "KeywordRanker.h"
+#include "config_json.h"
+
+/**
+ * The loaded dataset that is shared by all search sessions.
+ *
+ * It does not change after loading, so any number of `SomHunter` sessions
+ * may read it at the same time.
+ */
+class Dataset
+{
+public:
+	const Config config;
+	const DatasetFrames frames;
+	const DatasetFeatures features;
+	const KeywordRanker keywords;
+
+	Dataset() = delete;
+	inline Dataset(const Config &cfg)
+	  : config(cfg)
+	  , frames(cfg)
+	  , features(frames, cfg)
+	  , keywords(cfg)
+	{}
+
+	Dataset(const Dataset &) = delete;
+	Dataset &operator=(const Dataset &) = delete;
+};
+
+#endif
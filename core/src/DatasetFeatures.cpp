@@ -21,17 +21,34 @@
 
 #include "DatasetFeatures.h"
 
+#include <algorithm>
 #include <exception>
 #include <fstream>
 
 #include "config_json.h"
 #include "log.h"
 
-DatasetFeatures::DatasetFeatures(const DatasetFrames &p, const Config &config)
-  : n(p.size())
-  , features_dim(config.features_dim)
+static FeatureStorage
+parse_storage(const std::string &s)
+{
+	if (s.empty() || s == "fp32")
+		return FeatureStorage::Fp32;
+	if (s == "fp16")
+		return FeatureStorage::Fp16;
+	if (s == "int8")
+		return FeatureStorage::Int8;
+	if (s == "pq")
+		return FeatureStorage::Pq;
+
+	std::string msg{ "Unknown features storage: " + s };
+	warn(msg);
+	throw std::runtime_error(msg);
+}
+
+/** Opens the fp32 features file and skips its header */
+static std::ifstream
+open_features_file(const Config &config)
 {
-	data.resize(features_dim * n);
 	std::ifstream in(config.features_file, std::ios::binary);
 	if (!in.good()) {
 		warn("Features file doesn't look good");
@@ -40,6 +57,71 @@ DatasetFeatures::DatasetFeatures(const DatasetFrames &p, const Config &config)
 
 	// Skip the header
 	in.ignore(config.features_file_data_off);
+	return in;
+}
+
+const char *
+DatasetFeatures::storage_name(FeatureStorage s)
+{
+	switch (s) {
+		case FeatureStorage::Fp32:
+			return "fp32";
+		case FeatureStorage::Fp16:
+			return "fp16";
+		case FeatureStorage::Int8:
+			return "int8";
+		case FeatureStorage::Pq:
+			return "pq";
+		default:
+			return "unknown";
+	}
+}
+
+/** Maps the fp32 matrix of `n` frames from the features file */
+static const float *
+map_features_file(const Config &config, size_t n, MappedFile &mapped)
+{
+	mapped = MappedFile(config.features_file);
+
+	size_t off = config.features_file_data_off;
+	if (off % alignof(float) != 0 ||
+	    mapped.size() < off + sizeof(float) * config.features_dim * n) {
+		std::string msg{ "Features file does not fit the dataset: " +
+			         config.features_file };
+		warn(msg);
+		throw std::runtime_error(msg);
+	}
+	return mapped.at<float>(off);
+}
+
+DatasetFeatures::DatasetFeatures(const DatasetFrames &p, const Config &config)
+  : n(p.size())
+  , features_dim(config.features_dim)
+  , storage(parse_storage(config.features_storage))
+{
+	if (storage == FeatureStorage::Fp16)
+		load_fp16(config);
+	else if (storage == FeatureStorage::Int8)
+		load_int8(config);
+	else if (storage == FeatureStorage::Pq) {
+		if (config.features_pq_file.empty())
+			throw std::runtime_error(
+			  "The PQ storage needs features_pq_file");
+		map_fp32(config);
+		pq = ProductQuantizer(config.features_pq_file, n, features_dim);
+	} else
+		load_fp32(config);
+
+	if (config.features_sketches)
+		build_sketches();
+}
+
+void
+DatasetFeatures::load_fp32(const Config &config)
+{
+	data.resize(features_dim * n);
+	fp32 = data.data();
+	std::ifstream in{ open_features_file(config) };
 
 	if (!in.read(reinterpret_cast<char *>(data.data()),
 	             sizeof(float) * data.size()))
@@ -47,3 +129,229 @@ DatasetFeatures::DatasetFeatures(const DatasetFrames &p, const Config &config)
 	else
 		info("Feature matrix loaded OK");
 }
+
+void
+DatasetFeatures::map_fp32(const Config &config)
+{
+	fp32 = map_features_file(config, n, mapped);
+}
+
+void
+DatasetFeatures::load_int8(const Config &config)
+{
+	map_fp32(config);
+
+	// Symmetric quantization with the per-dimension maxima
+	scales8.assign(features_dim, 0.0f);
+	for (size_t i = 0; i < n; ++i)
+		for (size_t d = 0; d < features_dim; ++d)
+			scales8[d] = std::max(scales8[d], std::abs(fv(i)[d]));
+	for (auto &s : scales8)
+		s = s > 0 ? s / 127 : 1.0f;
+
+	data8.resize(features_dim * n);
+	for (size_t i = 0; i < n; ++i) {
+		const float *v = fv(i);
+		int8_t *v8 = data8.data() + features_dim * i;
+		for (size_t d = 0; d < features_dim; ++d)
+			v8[d] = int8_t(std::lround(v[d] / scales8[d]));
+	}
+
+	// Only the rerank reads the matrix from now on
+	mapped.evict();
+
+	info("Feature matrix mapped and quantized to int8 OK");
+}
+
+void
+DatasetFeatures::d_dot_all(const float *query, std::vector<float> &dists) const
+{
+	dists.resize(n);
+
+	if (storage == FeatureStorage::Fp32) {
+		with_dist_kernel<DistKernel::Dot>(features_dim, [&](auto dot) {
+			for (ImageId i = 0; i < n; ++i)
+				dists[i] = 1 - dot(query, fv(i), features_dim);
+		});
+		return;
+	}
+
+	if (storage == FeatureStorage::Fp16) {
+		for (ImageId i = 0; i < n; ++i)
+			dists[i] = d_dot(query, i);
+		return;
+	}
+
+	if (storage == FeatureStorage::Int8) {
+		std::vector<int8_t> q8(features_dim);
+		float q_scale = quantize_query8(
+		  query, scales8.data(), q8.data(), features_dim);
+
+		for (ImageId i = 0; i < n; ++i)
+			dists[i] =
+			  1 - q_scale * d_dot8(q8.data(),
+			                       data8.data() + features_dim * i,
+			                       features_dim);
+	} else {
+		std::vector<float> table(pq.table_size());
+		pq.dot_table(query, table.data());
+
+		pq.adc_all(table.data(), dists.data());
+		for (auto &d : dists)
+			d = 1 - d;
+	}
+
+	// Exact distances of the best candidates
+	std::vector<ImageId> cands(n);
+	for (ImageId i = 0; i < n; ++i)
+		cands[i] = i;
+
+	size_t n_cands = std::min(RERANK_CANDIDATES, n);
+	std::nth_element(cands.begin(),
+	                 cands.begin() + n_cands,
+	                 cands.end(),
+	                 [&dists](ImageId a, ImageId b) {
+		                 return dists[a] < dists[b];
+	                 });
+
+	for (size_t c = 0; c < n_cands; ++c)
+		dists[cands[c]] = d_dot_exact(query, cands[c]);
+}
+
+void
+DatasetFeatures::build_sketches()
+{
+	size_t words = sketch_words(features_dim);
+	sketches.resize(words * n);
+
+	std::vector<float> buf(features_dim);
+	for (size_t i = 0; i < n; ++i)
+		sign_sketch(row(i, buf.data()),
+		            features_dim,
+		            sketches.data() + words * i);
+
+	info("Feature sign sketches built OK");
+}
+
+std::vector<ImageId>
+DatasetFeatures::sketch_candidates(ImageId id) const
+{
+	size_t words = sketch_words(features_dim);
+	const uint64_t *q = sketch(id);
+
+	// The distances are small integers, so a histogram finds the limit
+	std::vector<unsigned> dists(n);
+	std::vector<size_t> hist(features_dim + 1, 0);
+	for (ImageId i = 0; i < n; ++i)
+		++hist[dists[i] = d_hamming(q, sketch(i), words)];
+
+	size_t n_cands = std::min(SKETCH_CANDIDATES, n);
+	size_t below = 0;
+	unsigned limit = 0;
+	while (below + hist[limit] < n_cands)
+		below += hist[limit++];
+
+	// All the frames under the limit and the rest of them at the limit
+	size_t at_limit = n_cands - below;
+	std::vector<ImageId> res;
+	res.reserve(n_cands);
+	for (ImageId i = 0; i < n; ++i) {
+		if (dists[i] == limit && at_limit > 0) {
+			--at_limit;
+			res.emplace_back(i);
+		} else if (dists[i] < limit)
+			res.emplace_back(i);
+	}
+
+	return res;
+}
+
+void
+DatasetFeatures::load_fp16(const Config &config)
+{
+	data16.resize(features_dim * n);
+
+	if (!config.features_fp16_file.empty()) {
+		std::ifstream in(config.features_fp16_file,
+		                 std::ios::binary | std::ios::ate);
+		if (!in.good()) {
+			warn("fp16 features file doesn't look good");
+			throw std::runtime_error("missing fp16 features file");
+		}
+
+		if (size_t(in.tellg()) != sizeof(uint16_t) * data16.size()) {
+			std::string msg{
+				"fp16 features file does not fit the dataset: " +
+				config.features_fp16_file
+			};
+			warn(msg);
+			throw std::runtime_error(msg);
+		}
+		in.seekg(0);
+
+		if (!in.read(reinterpret_cast<char *>(data16.data()),
+		             sizeof(uint16_t) * data16.size()))
+			warn("fp16 feature matrix reading problems");
+		else
+			info("fp16 feature matrix loaded OK");
+		return;
+	}
+
+	// Convert by chunks so that the fp32 matrix is never held whole
+	std::ifstream in{ open_features_file(config) };
+	std::vector<float> chunk(features_dim * FEATURES_CONVERT_CHUNK);
+
+	for (size_t i = 0; i < n; i += FEATURES_CONVERT_CHUNK) {
+		size_t rows = std::min(FEATURES_CONVERT_CHUNK, n - i);
+		size_t len = features_dim * rows;
+		if (!in.read(reinterpret_cast<char *>(chunk.data()),
+		             sizeof(float) * len)) {
+			warn("Feature matrix reading problems");
+			return;
+		}
+		float_to_half(
+		  chunk.data(), data16.data() + features_dim * i, len);
+	}
+
+	info("Feature matrix loaded and converted to fp16 OK");
+}
+
+void
+DatasetFeatures::write_fp16_features(const Config &config,
+                                     const std::string &out_filepath)
+{
+	Config fp16_config{ config };
+	fp16_config.features_storage = "fp16";
+	fp16_config.features_fp16_file.clear();
+
+	DatasetFeatures features(DatasetFrames(fp16_config), fp16_config);
+
+	std::ofstream ofs(out_filepath, std::ios::binary | std::ios::trunc);
+	if (!ofs)
+		throw std::runtime_error("Error opening file: " + out_filepath);
+
+	ofs.write(reinterpret_cast<const char *>(features.data16.data()),
+	          sizeof(uint16_t) * features.data16.size());
+	if (!ofs)
+		throw std::runtime_error("Error writing file: " + out_filepath);
+}
+
+void
+DatasetFeatures::write_pq_features(const Config &config,
+                                   const std::string &out_filepath,
+                                   size_t num_subspaces,
+                                   size_t iters,
+                                   size_t sample_size)
+{
+	DatasetFrames frames(config);
+	MappedFile mapped;
+	const float *points = map_features_file(config, frames.size(), mapped);
+
+	ProductQuantizer::train_and_write(points,
+	                                  frames.size(),
+	                                  config.features_dim,
+	                                  num_subspaces,
+	                                  iters,
+	                                  sample_size,
+	                                  out_filepath);
+}
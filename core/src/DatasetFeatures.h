@@ -28,24 +28,164 @@
 #include <map>
 #include <queue>
 
+#include "StageStats.h"
+#include "MappedFile.h"
+#include "ProductQuantizer.h"
 #include "distfs.h"
+#include "distfs16.h"
+#include "distfs8.h"
+#include "sketch.h"
+
+/** Precision of the stored feature matrix (`features_storage` config) */
+enum class FeatureStorage
+{
+	Fp32,
+	Fp16,
+	/**
+	 * The fp32 matrix is memory-mapped from the features file and the
+	 * full scans go over resident int8 codes first, only their best
+	 * candidates are re-ranked with the fp32 vectors. All the other
+	 * reads (Bayes, SOM) decode the codes.
+	 */
+	Int8,
+	/**
+	 * The same with product-quantized codes (`features_pq_file`), the
+	 * other reads use the reconstructions from the codebooks.
+	 */
+	Pq
+};
 
 class DatasetFeatures
 {
 	size_t n, features_dim;
+	FeatureStorage storage;
 	std::vector<float> data;
+	/** The matrix as IEEE halves if stored as fp16 */
+	std::vector<uint16_t> data16;
+
+	/** The fp32 matrix, either `data` or in `mapped` */
+	const float *fp32{ nullptr };
+	MappedFile mapped;
+	/** The int8 codes and the per-dimension scales of the int8 storage */
+	std::vector<int8_t> data8;
+	std::vector<float> scales8;
+	/** The codes of the PQ storage */
+	ProductQuantizer pq;
+	/**
+	 * Sign sketches of all frames (`sketch_words(dim)` words each) if
+	 * `features_sketches` is set, the KNN then only ranks the frames
+	 * with the closest sketches.
+	 */
+	std::vector<uint64_t> sketches;
 
 public:
 	DatasetFeatures(const DatasetFrames &, const Config &config);
 
 	size_t size() const { return n; }
 	size_t dim() const { return features_dim; }
+	FeatureStorage get_storage() const { return storage; }
+	static const char *storage_name(FeatureStorage s);
 
+	/**
+	 * Feature vector of the frame, not with the fp16 storage; with the
+	 * quantized ones it is read from the mapped file.
+	 */
 	inline const float *fv(size_t i) const
 	{
-		return data.data() + features_dim * i;
+		return fp32 + features_dim * i;
+	}
+
+	/** Feature vector of the frame, only with the fp16 storage */
+	inline const uint16_t *fv16(size_t i) const
+	{
+		return data16.data() + features_dim * i;
+	}
+
+	/** Codes of the frame, only with the int8 storage */
+	inline const int8_t *fv8(size_t i) const
+	{
+		return data8.data() + features_dim * i;
+	}
+
+	/**
+	 * Feature vector of the frame as floats, converted into `buf` (of
+	 * `dim()` floats) unless the matrix is stored as fp32. The int8
+	 * and PQ codes are decoded, the fp32 matrix is not read.
+	 */
+	inline const float *row(size_t i, float *buf) const
+	{
+		switch (storage) {
+			case FeatureStorage::Fp16:
+				half_to_float(fv16(i), buf, features_dim);
+				return buf;
+			case FeatureStorage::Int8:
+				dequantize8(
+				  fv8(i), scales8.data(), buf, features_dim);
+				return buf;
+			case FeatureStorage::Pq:
+				pq.decode(i, buf);
+				return buf;
+			default:
+				return fv(i);
+		}
+	}
+
+	/**
+	 * Writes the feature matrix given by the config as raw IEEE halves,
+	 * the file can be set as `features_fp16_file` in the config.
+	 */
+	static void write_fp16_features(const Config &config,
+	                                 const std::string &out_filepath);
+
+	/**
+	 * Trains the product quantization of the feature matrix given by
+	 * the config and writes its codes (see `pq_codes.h`), the file can
+	 * be set as `features_pq_file` in the config.
+	 */
+	static void write_pq_features(const Config &config,
+	                              const std::string &out_filepath,
+	                              size_t num_subspaces,
+	                              size_t iters,
+	                              size_t sample_size);
+
+	/**
+	 * Computes the dot product distances of the query to all frames.
+	 *
+	 * With the int8 and PQ storage they are approximated from the codes
+	 * and only the RERANK_CANDIDATES closest frames get the exact fp32
+	 * distances.
+	 */
+	void d_dot_all(const float *query, std::vector<float> &dists) const;
+
+	/** Sign sketch of the frame, only if the sketches are built */
+	inline const uint64_t *sketch(size_t i) const
+	{
+		return sketches.data() + sketch_words(features_dim) * i;
 	}
 
+	/**
+	 * Returns the SKETCH_CANDIDATES frames (in the order of their IDs)
+	 * whose sketches are the closest to the one of the frame.
+	 */
+	std::vector<ImageId> sketch_candidates(ImageId id) const;
+
+private:
+	/** Reads the fp32 matrix */
+	void load_fp32(const Config &config);
+
+	/** Reads the pre-converted fp16 matrix or converts the fp32 one */
+	void load_fp16(const Config &config);
+
+	/** Maps the fp32 matrix from the features file */
+	void map_fp32(const Config &config);
+
+	/** Maps the fp32 matrix and quantizes it to the int8 codes */
+	void load_int8(const Config &config);
+
+	/** Computes the sign sketches of all frames */
+	void build_sketches();
+
+public:
 	std::vector<ImageId> get_top_knn(const DatasetFrames &frames,
 	                                 ImageId id,
 	                                 size_t per_vid_limit = 0,
@@ -66,6 +206,9 @@ public:
 	  size_t per_vid_limit = 0,
 	  size_t from_shot_limit = 0) const
 	{
+		StageTimer timer(Stage::Knn);
+		PerfScope perf(Stage::Knn);
+
 		if (per_vid_limit == 0)
 			per_vid_limit = frames.size();
 
@@ -82,42 +225,55 @@ public:
 		                    decltype(cmp)>
 		  q3(cmp);
 
-		for (ImageId i{ 0 }; i < n; ++i) {
-			auto d = d_dot(id, i);
-			q3.emplace(i, d);
+		// the exact query for the rerank, even if the frames are
+		// quantized (a single row of the mapped matrix)
+		std::vector<float> buf(features_dim);
+		const float *query = quantized() ? fv(id) : row(id, buf.data());
+
+		if (sketches.empty()) {
+			std::vector<float> dists;
+			d_dot_all(query, dists);
+
+			for (ImageId i{ 0 }; i < n; ++i)
+				q3.emplace(i, dists[i]);
+		} else {
+			// Exact distances of the frames with close sketches
+			for (ImageId i : sketch_candidates(id))
+				q3.emplace(i, d_dot_exact(query, i));
 		}
 
 		std::vector<ImageId> res;
 		res.reserve(TOPKNN_LIMIT);
 
-		size_t num_videos = frames.get_num_videos();
-		std::vector<size_t> per_vid_frame_hist(num_videos, 0);
-		std::map<VideoId, std::map<ShotId, size_t>> frames_per_shot;
+		const VideoId *video_IDs = frames.video_IDs();
+		std::vector<size_t> per_vid_frame_hist(frames.get_num_videos(),
+		                                       0);
+		std::vector<size_t> frames_per_shot(frames.get_num_shots(), 0);
 
 		while (res.size() < TOPKNN_LIMIT) {
-			auto [adept_ID, f]{ q3.top() };
-
 			if (q3.empty())
 				break;
 
+			auto [adept_ID, f]{ q3.top() };
+
 			q3.pop();
 
-			auto vf = frames.get_frame(adept_ID);
+			VideoId video_ID = video_IDs[adept_ID];
+			size_t shot_idx = frames.get_shot_index(adept_ID);
 
 			// If we have already enough from this video
-			if (per_vid_frame_hist[vf.video_ID] >= per_vid_limit)
+			if (per_vid_frame_hist[video_ID] >= per_vid_limit)
 				continue;
 
 			// If we have already enough from this shot
-			if (frames_per_shot[vf.video_ID][vf.shot_ID] >=
-			    from_shot_limit)
+			if (frames_per_shot[shot_idx] >= from_shot_limit)
 				continue;
 
 			// Only if predicate is true
 			if (pred(adept_ID)) {
 				res.emplace_back(adept_ID);
-				per_vid_frame_hist[vf.video_ID]++;
-				frames_per_shot[vf.video_ID][vf.shot_ID]++;
+				per_vid_frame_hist[video_ID]++;
+				frames_per_shot[shot_idx]++;
 			}
 		}
 
@@ -126,11 +282,19 @@ public:
 
 	inline float d_manhattan(size_t i, size_t j) const
 	{
+		if (storage == FeatureStorage::Fp16)
+			return d_manhattan16(fv16(i), fv16(j), features_dim);
+		if (quantized())
+			return with_rows(i, j, ::d_manhattan);
 		return ::d_manhattan(fv(i), fv(j), features_dim);
 	}
 
 	inline float d_sqeucl(size_t i, size_t j) const
 	{
+		if (storage == FeatureStorage::Fp16)
+			return d_sqeucl16(fv16(i), fv16(j), features_dim);
+		if (quantized())
+			return with_rows(i, j, ::d_sqeucl);
 		return ::d_sqeucl(fv(i), fv(j), features_dim);
 	}
 
@@ -141,22 +305,86 @@ public:
 
 	inline float d_dot(size_t i, size_t j) const
 	{
-		return 1 - ::d_dot(fv(i), fv(j), features_dim);
+		return 1 - dot(i, j);
+	}
+
+	/**
+	 * Dot product distance of the query vector and the frame, computed
+	 * from the codes with the int8 and PQ storage.
+	 */
+	inline float d_dot(const float *query, size_t i) const
+	{
+		return 1 - dot(query, i);
 	}
 
 	inline float d_cos(size_t i, size_t j) const
 	{
-		float s = 0, w1 = 0, w2 = 0;
-		const float *iv = fv(i), *jv = fv(j);
-		for (size_t d = 0; d < features_dim; ++d) {
-			s += iv[d] * jv[d];
-			w1 += square(iv[d]);
-			w2 += square(jv[d]);
-		}
+		float s = dot(i, j), w1 = dot(i, i), w2 = dot(j, j);
 		if (w1 == 0 && w2 == 0)
 			return 0;
 		return 1 - s / sqrtf(w1 * w2);
 	}
+
+private:
+	inline bool quantized() const
+	{
+		return storage == FeatureStorage::Int8 ||
+		       storage == FeatureStorage::Pq;
+	}
+
+	inline float dot(size_t i, size_t j) const
+	{
+		if (storage == FeatureStorage::Fp16)
+			return d_dot16(fv16(i), fv16(j), features_dim);
+		if (quantized())
+			return dot(row(i, row_buf(0)), j);
+		return ::d_dot(fv(i), fv(j), features_dim);
+	}
+
+	/**
+	 * Dot product distance with the fp32 vector of the frame, i.e. from
+	 * the mapped matrix with the quantized storages (only their reranks
+	 * read it)
+	 */
+	inline float d_dot_exact(const float *query, size_t i) const
+	{
+		if (quantized())
+			return 1 - ::d_dot(query, fv(i), features_dim);
+		return d_dot(query, i);
+	}
+
+	inline float dot(const float *query, size_t i) const
+	{
+		if (storage == FeatureStorage::Fp16)
+			return d_dot16(query, fv16(i), features_dim);
+		if (storage == FeatureStorage::Int8)
+			return d_dot8f(
+			  query, fv8(i), scales8.data(), features_dim);
+		if (storage == FeatureStorage::Pq)
+			return pq.dot(query, i);
+		return ::d_dot(query, fv(i), features_dim);
+	}
+
+	/**
+	 * Per-thread buffer for a decoded row (two of them, `k` is 0 or 1),
+	 * so that the pairwise distances do not allocate
+	 */
+	inline float *row_buf(size_t k) const
+	{
+		thread_local std::vector<float> bufs[2];
+		bufs[k].resize(features_dim);
+		return bufs[k].data();
+	}
+
+	/** Distance `d` of the two frames decoded by `row` */
+	inline float with_rows(size_t i,
+	                       size_t j,
+	                       float (*d)(const float *,
+	                                  const float *,
+	                                  size_t)) const
+	{
+		return d(row(i, row_buf(0)), row(j, row_buf(1)), features_dim);
+	}
 };
 
 #endif
@@ -25,7 +25,14 @@
 #include "config_json.h"
 #include "log.h"
 
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <numeric>
+#include <type_traits>
+
+#include "frames_catalogue.h"
 
 std::vector<std::vector<KeywordId>>
 DatasetFrames::parse_top_kws_for_imgs_text_file(const std::string &filepath)
@@ -77,91 +84,325 @@ DatasetFrames::parse_top_kws_for_imgs_text_file(const std::string &filepath)
 DatasetFrames::DatasetFrames(const Config &config)
 {
 	// Save the config values
-	frames_path_prefix = config.frames_path_prefix;
 	offs = config.filename_offsets;
 
+	bool use_catalogue = false;
+	if (!config.frames_catalogue_file.empty()) {
+		use_catalogue =
+		  std::filesystem::exists(config.frames_catalogue_file);
+
+		if (!use_catalogue)
+			warn("Frames catalogue " << config.frames_catalogue_file
+			                         << " not found");
+	}
+
+	if (use_catalogue)
+		load_frames_catalogue(config.frames_catalogue_file);
+	else
+		load_frames_list(config.frames_list_file);
+
+	build_video_ranges();
+	build_shot_offsets();
+	build_shot_ranges();
+
+	if (size() == 0u)
+		warn("No image paths loaded");
+	else
+		info("Loaded " << size() << " image paths");
+}
+
+void
+DatasetFrames::load_frames_list(const std::string &filepath)
+{
 	info("Loading image paths");
 
-	std::ifstream in(config.frames_list_file);
+	std::ifstream in(filepath, std::ios::binary | std::ios::ate);
 	if (!in.good()) {
-		warn("Failed to open " << config.frames_list_file);
+		warn("Failed to open " << filepath);
 		throw std::runtime_error("missing image list");
 	}
 
-	{ // We can precompute this into binary file as well
+	// Read the whole list at once, frames will point into it
+	_frames_list.resize(size_t(in.tellg()));
+	in.seekg(0, std::ios::beg);
+	if (!in.read(_frames_list.data(), _frames_list.size()))
+		throw std::runtime_error("Error reading " + filepath);
 
-		size_t i = 0;
-		size_t prev_frame_vid_ID = SIZE_T_ERR_VAL;
+	const char *p_line = _frames_list.data();
+	const char *p_end = p_line + _frames_list.size();
 
-		size_t beg_img_ID = SIZE_T_ERR_VAL;
-		std::vector<std::pair<size_t, size_t>> range_pairs;
+	for (ImageId i = 0; p_line < p_end; ++i) {
+		const char *p_eol = static_cast<const char *>(
+		  std::memchr(p_line, '\n', p_end - p_line));
+		if (p_eol == nullptr)
+			p_eol = p_end;
 
-		for (std::string s; getline(in, s); ++i) {
+		auto vf = parse_video_filename(
+		  std::string_view(p_line, p_eol - p_line));
+		vf.frame_ID = i;
 
-			std::string tmp;
+		_frames.emplace_back(vf);
+		_list_video_IDs.emplace_back(vf.video_ID);
+		_list_shot_IDs.emplace_back(vf.shot_ID);
+		_list_frame_numbers.emplace_back(uint32_t(vf.frame_number));
 
-			auto vf =
-			  DatasetFrames::parse_video_filename(std::move(s));
+		p_line = p_eol + 1;
+	}
+
+	_video_IDs = _list_video_IDs.data();
+	_shot_IDs = _list_shot_IDs.data();
+	_frame_numbers = _list_frame_numbers.data();
+}
+
+void
+DatasetFrames::load_frames_catalogue(const std::string &filepath)
+{
+	info("Loading frames catalogue from " << filepath);
+
+	_catalogue = MappedFile(filepath);
+
+	if (_catalogue.size() < sizeof(FramesCatalogueHeader))
+		throw std::runtime_error("Invalid frames catalogue: " +
+		                         filepath);
 
-			vf.frame_ID = i;
+	const auto &hdr = *_catalogue.at<FramesCatalogueHeader>(0);
 
-			// Current video ID
-			size_t curr_frame_vid_ID = vf.video_ID;
+	if (std::memcmp(hdr.magic,
+	                FRAMES_CATALOGUE_MAGIC,
+	                sizeof(hdr.magic)) != 0 ||
+	    hdr.header_size != sizeof(FramesCatalogueHeader))
+		throw std::runtime_error("Invalid frames catalogue: " +
+		                         filepath);
 
-			_frames.emplace_back(std::move(vf));
+	if (hdr.version != FRAMES_CATALOGUE_VERSION) {
+		throw std::runtime_error(
+		  "Unsupported frames catalogue version " +
+		  std::to_string(hdr.version) + ": " + filepath);
+	}
+
+	auto check_section = [&](uint64_t off, uint64_t len) {
+		if (hdr.file_size != _catalogue.size() ||
+		    off > hdr.file_size || len > hdr.file_size - off)
+			throw std::runtime_error(
+			  "Corrupted frames catalogue: " + filepath);
+	};
+
+	const uint64_t n = hdr.num_frames;
+	check_section(hdr.video_IDs_off, n * sizeof(uint32_t));
+	check_section(hdr.shot_IDs_off, n * sizeof(uint32_t));
+	check_section(hdr.frame_nums_off, n * sizeof(uint32_t));
+	check_section(hdr.filename_offs_off, (n + 1) * sizeof(uint64_t));
+
+	const auto *video_IDs = _catalogue.at<uint32_t>(hdr.video_IDs_off);
+	const auto *shot_IDs = _catalogue.at<uint32_t>(hdr.shot_IDs_off);
+	const auto *frame_nums = _catalogue.at<uint32_t>(hdr.frame_nums_off);
+	const auto *fn_offs = _catalogue.at<uint64_t>(hdr.filename_offs_off);
+	const char *filenames = _catalogue.at<char>(hdr.filenames_off);
+
+	check_section(hdr.filenames_off, fn_offs[n]);
+
+	// The ID accessors are served straight from the mapping
+	static_assert(std::is_same_v<VideoId, uint32_t> &&
+	              std::is_same_v<ShotId, uint32_t>);
+	_video_IDs = video_IDs;
+	_shot_IDs = shot_IDs;
+	_frame_numbers = frame_nums;
+
+	_frames.reserve(n);
+	for (ImageId i = 0; i < n; ++i) {
+		_frames.emplace_back(
+		  std::string_view(filenames + fn_offs[i],
+		                   fn_offs[i + 1] - fn_offs[i]),
+		  video_IDs[i],
+		  shot_IDs[i],
+		  frame_nums[i],
+		  i);
+	}
+}
+
+void
+DatasetFrames::build_video_ranges()
+{
+	size_t prev_frame_vid_ID = SIZE_T_ERR_VAL;
 
-			// If we parsed all images from given video
-			if (prev_frame_vid_ID != curr_frame_vid_ID) {
-				size_t last_item_ID = _frames.size() - 1;
+	size_t beg_img_ID = SIZE_T_ERR_VAL;
+	std::vector<std::pair<size_t, size_t>> range_pairs;
 
-				// End previous range
-				if (prev_frame_vid_ID != SIZE_T_ERR_VAL) {
-					range_pairs.emplace_back(beg_img_ID,
-					                         last_item_ID);
-				}
-				// Start the new one
-				beg_img_ID = last_item_ID;
+	for (size_t i = 0; i < _frames.size(); ++i) {
+		// Current video ID
+		size_t curr_frame_vid_ID = _frames[i].video_ID;
 
-				prev_frame_vid_ID = curr_frame_vid_ID;
+		// If we parsed all images from given video
+		if (prev_frame_vid_ID != curr_frame_vid_ID) {
+			// End previous range
+			if (prev_frame_vid_ID != SIZE_T_ERR_VAL) {
+				range_pairs.emplace_back(beg_img_ID, i);
 			}
+			// Start the new one
+			beg_img_ID = i;
+
+			prev_frame_vid_ID = curr_frame_vid_ID;
 		}
-		// End the last FrameRange
+	}
+	// End the last FrameRange
+	if (!_frames.empty())
 		range_pairs.emplace_back(beg_img_ID, _frames.size());
 
-		/*
-		 * Now _frames container won't resize anymore.
-		 * Transfer ID pairs into iterators...
-		 */
-		auto base_it = _frames.begin();
-		for (auto &&[from_ID, to_ID] : range_pairs) {
-			_video_ID_to_frame_range.emplace_back(base_it + from_ID,
+	/*
+	 * Now _frames container won't resize anymore.
+	 * Transfer ID pairs into iterators...
+	 */
+	auto base_it = _frames.begin();
+	for (auto &&[from_ID, to_ID] : range_pairs) {
+		_video_ID_to_frame_range.emplace_back(base_it + from_ID,
+		                                      base_it + to_ID);
+	}
+}
+
+void
+DatasetFrames::build_shot_offsets()
+{
+	// Number of shot IDs used by each video
+	std::vector<size_t> num_video_shots;
+
+	for (ImageId i = 0; i < size(); ++i) {
+		if (_video_IDs[i] >= num_video_shots.size())
+			num_video_shots.resize(_video_IDs[i] + 1, 0);
+
+		size_t &num_shots = num_video_shots[_video_IDs[i]];
+		num_shots = std::max(num_shots, size_t(_shot_IDs[i]) + 1);
+	}
+
+	_video_shot_offsets.resize(num_video_shots.size() + 1);
+	_video_shot_offsets[0] = 0;
+	std::partial_sum(num_video_shots.begin(),
+	                 num_video_shots.end(),
+	                 _video_shot_offsets.begin() + 1);
+}
+
+void
+DatasetFrames::build_shot_ranges()
+{
+	for (auto &&range : _video_ID_to_frame_range) {
+		auto nums_begin = _frame_numbers + range.begin()->frame_ID;
+		if (!std::is_sorted(nums_begin, nums_begin + range.size()))
+			warn("Frames of video "
+			     << range.begin()->video_ID
+			     << " are not sorted by frame number");
+	}
+
+	// Shots are contiguous in their videos, empty ones get empty ranges
+	auto base_it = _frames.begin();
+	std::vector<std::pair<ImageId, ImageId>> shot_ranges(
+	  get_num_shots(), { ImageId(_frames.size()), 0 });
+
+	for (auto &&vf : _frames) {
+		auto &[from_ID, to_ID] = shot_ranges[get_shot_index(vf.frame_ID)];
+		from_ID = std::min(from_ID, vf.frame_ID);
+		to_ID = std::max(to_ID, ImageId(vf.frame_ID + 1));
+	}
+
+	_shot_idx_to_frame_range.clear();
+	_shot_idx_to_frame_range.reserve(shot_ranges.size());
+	for (auto &&[from_ID, to_ID] : shot_ranges) {
+		if (from_ID >= to_ID)
+			_shot_idx_to_frame_range.emplace_back(_frames.end(),
+			                                      _frames.end());
+		else
+			_shot_idx_to_frame_range.emplace_back(base_it + from_ID,
 			                                      base_it + to_ID);
-		}
 	}
+}
 
-	if (size() == 0u)
-		warn("No image paths loaded");
-	else
-		info("Loaded " << size() << " image paths");
+void
+DatasetFrames::write_frames_catalogue(const Config &config,
+                                      const std::string &out_filepath)
+{
+	// Always convert from the text list
+	Config list_config{ config };
+	list_config.frames_catalogue_file.clear();
+
+	DatasetFrames frames(list_config);
+
+	auto align = [](uint64_t off) {
+		return (off + FRAMES_CATALOGUE_ALIGN - 1) /
+		       FRAMES_CATALOGUE_ALIGN * FRAMES_CATALOGUE_ALIGN;
+	};
+
+	const size_t n = frames.size();
+	std::vector<uint32_t> video_IDs(n);
+	std::vector<uint32_t> shot_IDs(n);
+	std::vector<uint32_t> frame_nums(n);
+	std::vector<uint64_t> fn_offs{ 0 };
+	std::string filenames;
+
+	for (auto &&vf : frames) {
+		video_IDs[vf.frame_ID] = uint32_t(vf.video_ID);
+		shot_IDs[vf.frame_ID] = uint32_t(vf.shot_ID);
+		frame_nums[vf.frame_ID] = uint32_t(vf.frame_number);
+
+		filenames.append(vf.filename);
+		fn_offs.emplace_back(filenames.size());
+	}
+
+	FramesCatalogueHeader hdr{};
+	std::memcpy(hdr.magic, FRAMES_CATALOGUE_MAGIC, sizeof(hdr.magic));
+	hdr.version = FRAMES_CATALOGUE_VERSION;
+	hdr.header_size = sizeof(FramesCatalogueHeader);
+	hdr.num_frames = n;
+
+	hdr.video_IDs_off = align(sizeof(FramesCatalogueHeader));
+	hdr.shot_IDs_off = align(hdr.video_IDs_off + n * sizeof(uint32_t));
+	hdr.frame_nums_off = align(hdr.shot_IDs_off + n * sizeof(uint32_t));
+	hdr.filename_offs_off =
+	  align(hdr.frame_nums_off + n * sizeof(uint32_t));
+	hdr.filenames_off =
+	  align(hdr.filename_offs_off + (n + 1) * sizeof(uint64_t));
+	hdr.file_size = hdr.filenames_off + filenames.size();
+
+	std::ofstream ofs(out_filepath, std::ios::binary | std::ios::trunc);
+	if (!ofs)
+		throw std::runtime_error("Error opening file: " + out_filepath);
+
+	auto write_at = [&ofs](uint64_t off, const void *p, uint64_t len) {
+		// Pad up to the section offset
+		static const char zeros[FRAMES_CATALOGUE_ALIGN]{};
+		ofs.write(zeros, off - uint64_t(ofs.tellp()));
+
+		ofs.write(static_cast<const char *>(p), len);
+	};
+
+	write_at(0, &hdr, sizeof(hdr));
+	write_at(hdr.video_IDs_off, video_IDs.data(), n * sizeof(uint32_t));
+	write_at(hdr.shot_IDs_off, shot_IDs.data(), n * sizeof(uint32_t));
+	write_at(hdr.frame_nums_off, frame_nums.data(), n * sizeof(uint32_t));
+	write_at(hdr.filename_offs_off,
+	         fn_offs.data(),
+	         fn_offs.size() * sizeof(uint64_t));
+	write_at(hdr.filenames_off, filenames.data(), filenames.size());
+
+	if (!ofs)
+		throw std::runtime_error("Error writing file: " + out_filepath);
+
+	info("Frames catalogue written to " << out_filepath);
 }
 
 VideoFrame
-DatasetFrames::parse_video_filename(std::string &&filename)
+DatasetFrames::parse_video_filename(std::string_view filename)
 {
 	// Extract string representing video ID
-	std::string_view
-	videoIdString(filename.data() + offs.vid_ID_off, offs.vid_ID_len);
+	std::string_view videoIdString(
+	  filename.substr(offs.vid_ID_off, offs.vid_ID_len));
 
 	// Extract string representing shot ID
-	std::string_view
-	shotIdString(filename.data() + offs.shot_ID_off, offs.shot_ID_len);
+	std::string_view shotIdString(
+	  filename.substr(offs.shot_ID_off, offs.shot_ID_len));
 
 	// Extract string representing frame number
-	std::string_view
-	frameNumberString(filename.data() + offs.frame_num_off,
-	                  offs.frame_num_len);
+	std::string_view frameNumberString(
+	  filename.substr(offs.frame_num_off, offs.frame_num_len));
 
-	return VideoFrame(std::move(filename),
+	return VideoFrame(filename,
 	                  str_to_int(videoIdString),
 	                  str_to_int(shotIdString),
 	                  str_to_int(frameNumberString),
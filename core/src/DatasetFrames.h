@@ -22,11 +22,14 @@
 #ifndef image_path_h
 #define image_path_h
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "MappedFile.h"
 #include "common.h"
 #include "config_json.h"
 #include "utils.h"
@@ -37,25 +40,24 @@ using VideoFramePointer = const VideoFrame *;
 
 struct VideoFrame
 {
-	inline VideoFrame(std::string &&filename,
+	inline VideoFrame(std::string_view filename,
 	                  VideoId video_ID,
 	                  ShotId shot_ID,
 	                  ImageId frame_number,
 	                  ImageId image_ID)
-	  : filename(std::move(filename))
+	  : filename(filename)
 	  , video_ID(video_ID)
 	  , shot_ID(shot_ID)
 	  , frame_number(frame_number)
 	  , frame_ID(image_ID)
 	{}
 
-	std::string filename;
+	/** Points into the filename storage of DatasetFrames */
+	std::string_view filename;
 	VideoId video_ID;
 	ShotId shot_ID;
 	ImageId frame_number;
 	ImageId frame_ID;
-
-	bool liked{ false };
 };
 
 /**
@@ -158,18 +160,55 @@ class DatasetFrames
 	std::vector<FrameRange> _video_ID_to_frame_range;
 	std::vector<VideoFrame> _frames;
 
-	std::string frames_path_prefix;
+	/*
+	 * Storage of all the filenames, frames only keep views into it.
+	 * It is either the mapped binary catalogue or the loaded text list.
+	 */
+	MappedFile _catalogue;
+	std::vector<char> _frames_list;
+
+	/*
+	 * Video IDs, shot IDs and frame numbers of all frames indexed by
+	 * frame ID, for the scanning kernels that do not need the rest of
+	 * VideoFrame. They point straight into the mapped catalogue, or into
+	 * the `_list_*` arrays filled from the text list. The frame numbers
+	 * of each video are sorted, so they serve as its search array.
+	 */
+	const VideoId *_video_IDs{ nullptr };
+	const ShotId *_shot_IDs{ nullptr };
+	const uint32_t *_frame_numbers{ nullptr };
+
+	std::vector<VideoId> _list_video_IDs;
+	std::vector<ShotId> _list_shot_IDs;
+	std::vector<uint32_t> _list_frame_numbers;
+
+	/**
+	 * Offset of the first shot of each video in the global shot
+	 * numbering (one extra item at the end holds the number of shots).
+	 */
+	std::vector<size_t> _video_shot_offsets;
+
+	/** Map from global shot index (see `get_shot_index`) to its frames */
+	std::vector<FrameRange> _shot_idx_to_frame_range;
+
 	VideoFilenameOffsets offs{};
 
 public:
 	DatasetFrames(const Config &config);
 
-	std::string operator[](ImageId i) const
+	/** Filename of the frame (without the path prefix) */
+	std::string_view filename(ImageId i) const
 	{
-		return frames_path_prefix +
-		       std::string{ _frames.at(i).filename };
+		return _frames.at(i).filename;
 	}
 
+	/**
+	 * Writes the frames list given by the config into a binary
+	 * catalogue (see `frames_catalogue.h`).
+	 */
+	static void write_frames_catalogue(const Config &config,
+	                                   const std::string &out_filepath);
+
 	std::vector<VideoFrame>::iterator end() { return _frames.end(); };
 	std::vector<VideoFrame>::iterator begin() { return _frames.begin(); };
 
@@ -182,7 +221,7 @@ public:
 		return _frames.begin();
 	};
 
-	size_t get_num_videos() const { return _frames.back().video_ID + 1; }
+	size_t get_num_videos() const { return _video_shot_offsets.size() - 1; }
 
 	VideoFrame &get_frame(ImageId i) { return _frames[i]; }
 
@@ -197,13 +236,32 @@ public:
 
 	VideoId get_video_id(ImageId img_ID) const
 	{
-		if (img_ID >= _frames.size()) {
+		if (img_ID >= size()) {
 			return VIDEO_ID_ERR_VAL;
 		} else {
-			return get_frame(img_ID).video_ID;
+			return _video_IDs[img_ID];
 		}
 	}
 
+	/** Video IDs of all frames indexed by frame ID */
+	const VideoId *video_IDs() const { return _video_IDs; }
+
+	/** Shot IDs of all frames indexed by frame ID */
+	const ShotId *shot_IDs() const { return _shot_IDs; }
+
+	/** Number of shots in the global shot numbering */
+	size_t get_num_shots() const { return _video_shot_offsets.back(); }
+
+	/**
+	 * Returns index of the frame's shot that is unique across all
+	 * videos, i.e. from [0, get_num_shots()).
+	 */
+	size_t get_shot_index(ImageId img_ID) const
+	{
+		return _video_shot_offsets[_video_IDs[img_ID]] +
+		       _shot_IDs[img_ID];
+	}
+
 	/**
 	 * Return copy of FrameRange representing all selected frames from
 	 * the given video.
@@ -224,23 +282,46 @@ public:
 		// Get video range
 		auto video_range = _video_ID_to_frame_range[video_ID];
 
-		auto from_it = video_range.begin();
-		auto to_it = video_range.end();
+		const uint32_t *nums_begin =
+		  _frame_numbers + video_range.begin()->frame_ID;
+		auto nums_end = nums_begin + video_range.size();
+
+		// Binary search the video's sorted frame numbers
+		auto from = std::lower_bound(nums_begin, nums_end, frame_num_from,
+		                             [](uint32_t num, size_t val) {
+			                             return num < val;
+		                             });
+		auto to = std::upper_bound(from, nums_end, frame_num_to,
+		                           [](size_t val, uint32_t num) {
+			                           return val < num;
+		                           });
+
+		return FrameRange(video_range.begin() + (from - nums_begin),
+		                  video_range.begin() + (to - nums_begin));
+	}
 
-		--to_it;
+	/**
+	 * Returns new instance of FrameRange representing all frames of the
+	 * given shot (empty if the video has no such shot).
+	 */
+	FrameRange get_shot_frames(VideoId video_ID, ShotId shot_ID) const
+	{
+		auto video_range = _video_ID_to_frame_range[video_ID];
+		size_t shot_idx = _video_shot_offsets[video_ID] + shot_ID;
 
-		// Rewind to the first wanted frame
-		while (from_it->frame_number < frame_num_from) {
-			++from_it;
-		}
+		if (shot_idx >= _video_shot_offsets[video_ID + 1])
+			return FrameRange(video_range.end(), video_range.end());
 
-		// Rewind to the last wanted frame
-		while (to_it->frame_number > frame_num_to) {
-			--to_it;
-		}
+		return _shot_idx_to_frame_range[shot_idx];
+	}
 
-		// Return one frame behind to behave begin/end-like
-		return FrameRange(from_it, to_it + 1);
+	/**
+	 * Returns FrameRange of the shot with the global index from
+	 * [0, get_num_shots()), see `get_shot_index`.
+	 */
+	FrameRange get_shot_frames(size_t shot_idx) const
+	{
+		return _shot_idx_to_frame_range[shot_idx];
 	}
 
 	/** Translation to VideoFrameRefs from vector ids or FrameRange */
@@ -259,11 +340,26 @@ private:
 	static std::vector<std::vector<KeywordId>>
 	parse_top_kws_for_imgs_text_file(const std::string &filepath);
 
+	/** Parses the text list of frame filenames */
+	void load_frames_list(const std::string &filepath);
+
+	/** Maps the binary frame catalogue */
+	void load_frames_catalogue(const std::string &filepath);
+
+	/** Creates the video ID to frame range mapping */
+	void build_video_ranges();
+
+	/** Creates the global shot numbering */
+	void build_shot_offsets();
+
+	/** Creates the shot to frames mapping */
+	void build_shot_ranges();
+
 	/**
 	 * From filename string it parses useful info as video/shot/frame ID
 	 * etc.
 	 */
-	VideoFrame parse_video_filename(std::string &&filename);
+	VideoFrame parse_video_filename(std::string_view filename);
 };
 
 #endif
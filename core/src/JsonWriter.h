@@ -0,0 +1,209 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef json_writer_h
+#define json_writer_h
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Writes JSON directly into a string buffer, without building the value
+ * tree that json11 needs. The output has the same layout as
+ * `json11::Json::dump`, but the caller is responsible for the key order
+ * (json11 sorts them) and for the proper nesting.
+ */
+class JsonWriter
+{
+	std::string &buf;
+	/** For each open object/array if it already has some item */
+	std::vector<char> has_items;
+
+public:
+	/** Appends to the buffer (clear it first to reuse it) */
+	JsonWriter(std::string &buf)
+	  : buf(buf)
+	{}
+
+	JsonWriter &begin_object()
+	{
+		separate();
+		buf += '{';
+		has_items.push_back(false);
+		return *this;
+	}
+
+	JsonWriter &end_object()
+	{
+		buf += '}';
+		has_items.pop_back();
+		return *this;
+	}
+
+	JsonWriter &begin_array()
+	{
+		separate();
+		buf += '[';
+		has_items.push_back(false);
+		return *this;
+	}
+
+	JsonWriter &end_array()
+	{
+		buf += ']';
+		has_items.pop_back();
+		return *this;
+	}
+
+	/** Writes the key of the next object member */
+	JsonWriter &key(std::string_view k)
+	{
+		separate();
+		write_string(k);
+		buf += ": ";
+		// The value follows without a separator
+		has_items.back() = false;
+		return *this;
+	}
+
+	JsonWriter &value(std::string_view v)
+	{
+		separate();
+		write_string(v);
+		return *this;
+	}
+
+	JsonWriter &value(const char *v) { return value(std::string_view(v)); }
+
+	JsonWriter &value(int64_t v)
+	{
+		separate();
+		write_number(v);
+		return *this;
+	}
+
+	JsonWriter &value(int v) { return value(int64_t(v)); }
+
+	JsonWriter &value(double v)
+	{
+		separate();
+		if (std::isfinite(v))
+			write_number(v);
+		else
+			buf += "null";
+		return *this;
+	}
+
+	JsonWriter &value(bool v)
+	{
+		separate();
+		buf += v ? "true" : "false";
+		return *this;
+	}
+
+private:
+	void separate()
+	{
+		if (has_items.empty())
+			return;
+
+		if (has_items.back())
+			buf += ", ";
+		has_items.back() = true;
+	}
+
+	void write_number(int64_t v)
+	{
+		char tmp[32];
+		auto [end, ec] = std::to_chars(tmp, tmp + sizeof(tmp), v);
+		buf.append(tmp, end);
+	}
+
+	/** Same digits as the "%.17g" of json11, but locale independent */
+	void write_number(double v)
+	{
+		char tmp[32];
+		auto [end, ec] = std::to_chars(
+		  tmp, tmp + sizeof(tmp), v, std::chars_format::general, 17);
+		buf.append(tmp, end);
+	}
+
+	/** Writes the escaped string the same way as json11 does */
+	void write_string(std::string_view s)
+	{
+		static const char hex[] = "0123456789abcdef";
+
+		buf += '"';
+
+		// Copy the runs of characters that need no escaping at once
+		size_t run_begin = 0;
+		for (size_t i = 0; i < s.size(); ++i) {
+			unsigned char ch = s[i];
+			if (ch > 0x1f && ch != '\\' && ch != '"' && ch != 0xe2)
+				continue;
+
+			const char *esc = nullptr;
+			size_t esc_len = 1;
+			char u00[] = "\\u00xx";
+
+			if (ch == '\\')
+				esc = "\\\\";
+			else if (ch == '"')
+				esc = "\\\"";
+			else if (ch == '\b')
+				esc = "\\b";
+			else if (ch == '\f')
+				esc = "\\f";
+			else if (ch == '\n')
+				esc = "\\n";
+			else if (ch == '\r')
+				esc = "\\r";
+			else if (ch == '\t')
+				esc = "\\t";
+			else if (ch <= 0x1f) {
+				u00[4] = hex[ch >> 4];
+				u00[5] = hex[ch & 0xf];
+				esc = u00;
+			} else if (s.substr(i, 3) == "\xe2\x80\xa8") {
+				esc = "\\u2028";
+				esc_len = 3;
+			} else if (s.substr(i, 3) == "\xe2\x80\xa9") {
+				esc = "\\u2029";
+				esc_len = 3;
+			} else
+				continue;
+
+			buf.append(s.data() + run_begin, i - run_begin);
+			buf += esc;
+			i += esc_len - 1;
+			run_begin = i + 1;
+		}
+		buf.append(s.data() + run_begin, s.size() - run_begin);
+
+		buf += '"';
+	}
+};
+
+#endif
@@ -22,6 +22,14 @@
 #include "KeywordRanker.h"
 
 #include <cmath>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <thread>
+
+#include "StageStats.h"
+#include "Trace.h"
+#include "kw_bundle.h"
 
 std::vector<Keyword>
 KeywordRanker::parse_kw_classes_text_file(const std::string &filepath)
@@ -91,26 +99,45 @@ KeywordRanker::parse_kw_classes_text_file(const std::string &filepath)
 	return result_keywords;
 }
 
-FeatureVector
-KeywordRanker::parse_float_vector(const std::string &filepath,
-                                  size_t dim,
-                                  size_t begin_offset)
+KeywordRanker::KeywordRanker(const Config &config)
+  : kw_features_dim(config.pre_PCA_features_dim)
+  , kw_pca_dim(config.kw_PCA_mat_dim)
+{
+	bool use_bundle = false;
+	if (!config.kw_bundle_file.empty()) {
+		use_bundle = std::filesystem::exists(config.kw_bundle_file);
+
+		if (!use_bundle)
+			warn("Keyword bundle " << config.kw_bundle_file
+			                       << " not found");
+	}
+
+	if (use_bundle)
+		load_kw_bundle(config.kw_bundle_file, config);
+	else
+		load_kw_files(config);
+
+	if (config.kw_precompute_projections && kw_projected == nullptr)
+		precompute_projections();
+}
+
+size_t
+KeywordRanker::read_float_matrix(const std::string &filepath,
+                                 size_t row_dim,
+                                 std::vector<float> &dst,
+                                 size_t num_rows,
+                                 size_t begin_offset)
 {
 	// Open file for reading as binary from the end side
 	std::ifstream ifs(filepath, std::ios::binary | std::ios::ate);
 
 	// If failed to open file
-	if (!ifs)
+	if (!ifs) {
 		throw std::runtime_error("Error opening file: " + filepath);
-
-	// Get end of file
-	auto end = ifs.tellg();
-
-	// Get iterator to begining
-	ifs.seekg(0, std::ios::beg);
+	}
 
 	// Compute size of file
-	auto size = std::size_t(end - ifs.tellg());
+	auto size = std::size_t(ifs.tellg());
 
 	// If emtpy file
 	if (size == 0) {
@@ -118,99 +145,257 @@ KeywordRanker::parse_float_vector(const std::string &filepath,
 	}
 
 	// Calculate byte length of each row (dim_N * sizeof(float))
-	size_t row_byte_len = dim * sizeof(float);
-
-	// Create line buffer
-	std::vector<char> line_byte_buffer;
-	line_byte_buffer.resize(row_byte_len);
+	size_t row_byte_len = row_dim * sizeof(float);
 
-	// Start reading at this offset
-	ifs.ignore(begin_offset);
+	size_t avail_rows =
+	  size > begin_offset ? (size - begin_offset) / row_byte_len : 0;
 
-	// Initialize vector of floats for this row
-	std::vector<float> features_vector;
-	features_vector.reserve(dim);
+	if (num_rows == 0)
+		num_rows = avail_rows;
 
-	// Read binary "lines" until EOF
-	while (ifs.read(line_byte_buffer.data(), row_byte_len)) {
-		size_t curr_offset = 0;
+	if (num_rows > avail_rows) {
+		throw std::runtime_error("Not enough data in file: " +
+		                         filepath);
+	}
 
-		// Iterate through all floats in a row
-		for (size_t i = 0; i < dim; ++i) {
-			features_vector.emplace_back(*reinterpret_cast<float *>(
-			  line_byte_buffer.data() + curr_offset));
+	// Read all the rows at once right behind the current data
+	size_t dst_off = dst.size();
+	dst.resize(dst_off + num_rows * row_dim);
 
-			curr_offset += sizeof(float);
-		}
-
-		// Read just one line
-		break;
+	ifs.seekg(begin_offset, std::ios::beg);
+	if (!ifs.read(reinterpret_cast<char *>(dst.data() + dst_off),
+	              num_rows * row_byte_len)) {
+		throw std::runtime_error("Error reading file: " + filepath);
 	}
 
-	return features_vector;
+	return num_rows;
 }
 
-FeatureMatrix
-KeywordRanker::parse_float_matrix(const std::string &filepath,
-                                  size_t row_dim,
-                                  size_t begin_offset)
+void
+KeywordRanker::load_kw_files(const Config &config)
 {
-	// Open file for reading as binary from the end side
-	std::ifstream ifs(filepath, std::ios::binary | std::ios::ate);
+	keywords = parse_kw_classes_text_file(config.kws_file);
 
-	// If failed to open file
-	if (!ifs) {
-		throw std::runtime_error("Error opening file: " + filepath);
-	}
+	info("loading keyword model from separate files");
 
-	// Get end of file
-	auto end = ifs.tellg();
+	// Small ones go first so that the big matrix is not copied on append
+	read_float_matrix(
+	  config.kw_bias_vec_file, kw_features_dim, kw_model_data, 1);
+	read_float_matrix(
+	  config.kw_PCA_mean_vec_file, kw_features_dim, kw_model_data, 1);
+	read_float_matrix(
+	  config.kw_PCA_mat_file, kw_features_dim, kw_model_data, kw_pca_dim);
 
-	// Get iterator to begining
-	ifs.seekg(0, std::ios::beg);
+	size_t num_rows = read_float_matrix(
+	  config.kw_scores_mat_file, kw_features_dim, kw_model_data);
 
-	// Compute size of file
-	auto size = std::size_t(end - ifs.tellg());
-
-	// If emtpy file
-	if (size == 0) {
-		throw std::runtime_error("Empty file opened!");
+	// Rows are indexed by keyword IDs (the keywords are sorted by them)
+	if (!keywords.empty() && keywords.back().kw_ID >= num_rows) {
+		throw std::runtime_error("Keyword matrix is too small: " +
+		                         config.kw_scores_mat_file);
 	}
+	kw_num_rows = num_rows;
+
+	const float *p_data = kw_model_data.data();
+	kw_features_bias_vec = p_data;
+	p_data += kw_features_dim;
+	kw_pca_mean_vec = p_data;
+	p_data += kw_features_dim;
+	kw_pca_mat = p_data;
+	p_data += kw_pca_dim * kw_features_dim;
+	kw_features = p_data;
+
+	info("keyword model loaded");
+}
 
-	// Calculate byte length of each row (dim_N * sizeof(float))
-	size_t row_byte_len = row_dim * sizeof(float);
+void
+KeywordRanker::load_kw_bundle(const std::string &filepath,
+                              const Config &config)
+{
+	info("loading keyword bundle from " << filepath);
+
+	kw_bundle = MappedFile(filepath);
 
-	// Create line buffer
-	std::vector<char> line_byte_buffer;
-	line_byte_buffer.resize(row_byte_len);
+	if (kw_bundle.size() < sizeof(KwBundleHeader))
+		throw std::runtime_error("Invalid keyword bundle: " + filepath);
 
-	// Start reading at this offset
-	ifs.ignore(begin_offset);
+	const KwBundleHeader &hdr = *kw_bundle.at<KwBundleHeader>(0);
 
-	// Declare result structure
-	std::vector<std::vector<float>> result_features;
+	if (std::memcmp(hdr.magic, KW_BUNDLE_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.header_size != sizeof(KwBundleHeader))
+		throw std::runtime_error("Invalid keyword bundle: " + filepath);
 
-	// Read binary "lines" until EOF
-	while (ifs.read(line_byte_buffer.data(), row_byte_len)) {
-		// Initialize vector of floats for this row
-		std::vector<float> features_vector;
-		features_vector.reserve(row_dim);
+	if (hdr.version != KW_BUNDLE_VERSION) {
+		throw std::runtime_error(
+		  "Unsupported keyword bundle version " +
+		  std::to_string(hdr.version) + ": " + filepath);
+	}
 
-		size_t curr_offset = 0;
+	if (hdr.file_size != kw_bundle.size())
+		throw std::runtime_error("Truncated keyword bundle: " +
+		                         filepath);
 
-		// Iterate through all floats in a row
-		for (size_t i = 0; i < row_dim; ++i) {
-			features_vector.emplace_back(*reinterpret_cast<float *>(
-			  line_byte_buffer.data() + curr_offset));
+	if (hdr.pre_PCA_dim != config.pre_PCA_features_dim ||
+	    hdr.PCA_dim != config.kw_PCA_mat_dim) {
+		throw std::runtime_error(
+		  "Keyword bundle dimensions do not match the config: " +
+		  filepath);
+	}
 
-			curr_offset += sizeof(float);
+	auto check_section = [&](uint64_t off, uint64_t len) {
+		if (off > hdr.file_size || len > hdr.file_size - off)
+			throw std::runtime_error(
+			  "Corrupted keyword bundle: " + filepath);
+	};
+
+	const uint64_t row_len = hdr.pre_PCA_dim * sizeof(float);
+	check_section(hdr.keywords_off,
+	              hdr.num_keywords * sizeof(KwBundleKeyword));
+	check_section(hdr.str_offsets_off,
+	              (hdr.num_strings + 1) * sizeof(uint64_t));
+	check_section(hdr.weights_off, hdr.num_weight_rows * row_len);
+	check_section(hdr.bias_off, row_len);
+	check_section(hdr.PCA_mat_off, hdr.PCA_dim * row_len);
+	check_section(hdr.PCA_mean_off, row_len);
+	if (hdr.projected_off != 0)
+		check_section(hdr.projected_off,
+		              hdr.num_weight_rows * hdr.PCA_dim *
+		                sizeof(float));
+
+	const auto *kw_recs = kw_bundle.at<KwBundleKeyword>(hdr.keywords_off);
+	const auto *str_offs = kw_bundle.at<uint64_t>(hdr.str_offsets_off);
+	const char *str_data = kw_bundle.at<char>(hdr.str_data_off);
+
+	check_section(hdr.str_data_off, str_offs[hdr.num_strings]);
+
+	// Only the keyword strings are copied, matrices stay in the mapping
+	keywords.clear();
+	keywords.reserve(hdr.num_keywords);
+	for (size_t i = 0; i < hdr.num_keywords; ++i) {
+		const KwBundleKeyword &rec = kw_recs[i];
+
+		if (rec.first_str + rec.num_strs > hdr.num_strings ||
+		    rec.kw_ID >= hdr.num_weight_rows)
+			throw std::runtime_error(
+			  "Corrupted keyword bundle: " + filepath);
+
+		SynsetStrings synset_strings;
+		synset_strings.reserve(rec.num_strs);
+		for (size_t j = rec.first_str; j < rec.first_str + rec.num_strs;
+		     ++j) {
+			synset_strings.emplace_back(str_data + str_offs[j],
+			                            str_offs[j + 1] -
+			                              str_offs[j]);
 		}
 
-		// Insert this row into the result
-		result_features.emplace_back(std::move(features_vector));
+		keywords.emplace_back(Keyword{ KeywordId(rec.kw_ID),
+		                               SynsetId(rec.synset_ID),
+		                               std::move(synset_strings),
+		                               KwDescription{},
+		                               std::vector<ImageId>{} });
 	}
 
-	return result_features;
+	kw_num_rows = hdr.num_weight_rows;
+	kw_features = kw_bundle.at<float>(hdr.weights_off);
+	kw_features_bias_vec = kw_bundle.at<float>(hdr.bias_off);
+	kw_pca_mat = kw_bundle.at<float>(hdr.PCA_mat_off);
+	kw_pca_mean_vec = kw_bundle.at<float>(hdr.PCA_mean_off);
+	if (hdr.projected_off != 0)
+		kw_projected = kw_bundle.at<float>(hdr.projected_off);
+
+	info("keyword bundle loaded, " << keywords.size() << " keywords");
+}
+
+void
+KeywordRanker::write_kw_bundle(const Config &config,
+                               const std::string &out_filepath)
+{
+	// Always convert from the separate files
+	Config files_config{ config };
+	files_config.kw_bundle_file.clear();
+
+	files_config.kw_precompute_projections = true;
+
+	KeywordRanker kr(files_config);
+
+	auto align = [](uint64_t off) {
+		return (off + KW_BUNDLE_ALIGN - 1) / KW_BUNDLE_ALIGN *
+		       KW_BUNDLE_ALIGN;
+	};
+
+	// Build the string table
+	std::vector<KwBundleKeyword> kw_recs;
+	std::vector<uint64_t> str_offs{ 0 };
+	std::string str_data;
+	for (auto &&kw : kr.keywords) {
+		kw_recs.emplace_back(KwBundleKeyword{
+		  kw.kw_ID, kw.synset_ID, str_offs.size() - 1, 0 });
+
+		for (auto &&str : kw.synset_strs) {
+			str_data += str;
+			str_offs.emplace_back(str_data.size());
+			++kw_recs.back().num_strs;
+		}
+	}
+
+	const uint64_t row_len = kr.kw_features_dim * sizeof(float);
+
+	KwBundleHeader hdr{};
+	std::memcpy(hdr.magic, KW_BUNDLE_MAGIC, sizeof(hdr.magic));
+	hdr.version = KW_BUNDLE_VERSION;
+	hdr.header_size = sizeof(KwBundleHeader);
+	hdr.num_keywords = kw_recs.size();
+	hdr.num_weight_rows = kr.kw_num_rows;
+	hdr.num_strings = str_offs.size() - 1;
+	hdr.pre_PCA_dim = kr.kw_features_dim;
+	hdr.PCA_dim = kr.kw_pca_dim;
+
+	hdr.keywords_off = align(sizeof(KwBundleHeader));
+	hdr.str_offsets_off =
+	  align(hdr.keywords_off + kw_recs.size() * sizeof(KwBundleKeyword));
+	hdr.str_data_off =
+	  align(hdr.str_offsets_off + str_offs.size() * sizeof(uint64_t));
+	hdr.weights_off = align(hdr.str_data_off + str_data.size());
+	hdr.bias_off = align(hdr.weights_off + hdr.num_weight_rows * row_len);
+	hdr.PCA_mat_off = align(hdr.bias_off + row_len);
+	hdr.PCA_mean_off = align(hdr.PCA_mat_off + hdr.PCA_dim * row_len);
+	hdr.projected_off = align(hdr.PCA_mean_off + row_len);
+	hdr.file_size = hdr.projected_off + hdr.num_weight_rows *
+	                                      hdr.PCA_dim * sizeof(float);
+
+	std::ofstream ofs(out_filepath, std::ios::binary | std::ios::trunc);
+	if (!ofs)
+		throw std::runtime_error("Error opening file: " + out_filepath);
+
+	auto write_at = [&ofs](uint64_t off, const void *p, uint64_t len) {
+		// Pad up to the section offset
+		static const char zeros[KW_BUNDLE_ALIGN]{};
+		ofs.write(zeros, off - uint64_t(ofs.tellp()));
+
+		ofs.write(static_cast<const char *>(p), len);
+	};
+
+	write_at(0, &hdr, sizeof(hdr));
+	write_at(hdr.keywords_off,
+	         kw_recs.data(),
+	         kw_recs.size() * sizeof(KwBundleKeyword));
+	write_at(hdr.str_offsets_off,
+	         str_offs.data(),
+	         str_offs.size() * sizeof(uint64_t));
+	write_at(hdr.str_data_off, str_data.data(), str_data.size());
+	write_at(
+	  hdr.weights_off, kr.kw_features, hdr.num_weight_rows * row_len);
+	write_at(hdr.bias_off, kr.kw_features_bias_vec, row_len);
+	write_at(hdr.PCA_mat_off, kr.kw_pca_mat, hdr.PCA_dim * row_len);
+	write_at(hdr.PCA_mean_off, kr.kw_pca_mean_vec, row_len);
+	write_at(hdr.projected_off,
+	         kr.kw_projected,
+	         hdr.num_weight_rows * hdr.PCA_dim * sizeof(float));
+
+	if (!ofs)
+		throw std::runtime_error("Error writing file: " + out_filepath);
+
+	info("keyword bundle written to " << out_filepath);
 }
 
 KwSearchIds
@@ -331,155 +516,213 @@ KeywordRanker::rank_query(const std::vector<std::vector<KeywordId>> &positive,
                           const DatasetFrames &frames,
                           const Config &cfg) const
 {
+	TraceSpan span("KeywordRanker::rank_query");
+
 	// Don't waste time
 	if (positive.empty())
 		return;
 
-	// Get the most relevant images for this query
+	// Get distances of all images from this query, the order does not
+	// matter here so they are not sorted
 	//  Distance is from [0, 1]
-	std::vector<std::pair<ImageId, float>> sorted_frames =
-	  get_sorted_frames(positive, negative, features, frames, cfg);
+	std::vector<float> dists =
+	  get_frame_dists(positive, negative, features, frames, cfg);
 
 	// Update the model
-	for (auto &&[frame_ID, dist] : sorted_frames) {
-		model.adjust(frame_ID, std::exp(dist * -42));
-	}
+	model.adjust_exp(dists, -42.0f);
 
 	model.normalize();
 }
 
 void
-KeywordRanker::apply_temp_queries(std::vector<std::vector<float>> &dist_cache,
-                                  ImageId img_ID,
-                                  const FeatureMatrix &queries,
-                                  size_t query_idx,
-                                  float &result_dist,
-                                  const DatasetFeatures &features,
-                                  const DatasetFrames &frames) const
+KeywordRanker::scan_query_dists(const FeatureVector &query,
+                                const DatasetFeatures &features,
+                                std::vector<float> &dists)
 {
-	// If no queries left
-	if (query_idx >= queries.size())
-		return;
+	StageTimer timer(Stage::KeywordScan);
+	PerfScope perf(Stage::KeywordScan);
 
-	// To avoid getting stuck in loooooong computation
-	if (query_idx > MAX_NUM_TEMP_QUERIES)
-		return;
+	features.d_dot_all(query.data(), dists);
 
-	float local_min_dist = 1.0f;
+	// Scale the cosine distances to [0.0f, 1.0f]
+	for (auto &d : dists)
+		d /= 2.0f;
+}
 
-	auto img_it = frames.get_frame_it(img_ID);
-	VideoId vid_ID = img_it->video_ID;
+void
+KeywordRanker::fold_temporal_min(const std::vector<float> &succ_dists,
+                                 const DatasetFrames &frames,
+                                 std::vector<float> &dists)
+{
+	/*
+	 * Walk the frames backwards and keep the successors within the
+	 * window in a deque with increasing distances, so the front is always
+	 * the minimum.
+	 */
+	std::deque<ImageId> window;
+	const VideoId *video_IDs = frames.video_IDs();
+	VideoId vid_ID = VIDEO_ID_ERR_VAL;
+
+	for (ImageId img_ID = dists.size(); img_ID-- > 0;) {
+		// Successors must be from the same video
+		VideoId curr_vid_ID = video_IDs[img_ID];
+		if (curr_vid_ID != vid_ID) {
+			window.clear();
+			vid_ID = curr_vid_ID;
+		}
 
-	// Iterate over successor frames
-	for (size_t i_succ = 0; i_succ < KW_TEMPORAL_SPAN; ++i_succ) {
-		++img_it;
-		if (img_it == frames.end() || img_it->video_ID != vid_ID)
-			break;
+		// Drop successors that are out of the span
+		while (!window.empty() &&
+		       window.front() > img_ID + KW_TEMPORAL_SPAN)
+			window.pop_front();
+
+		float local_min_dist = 1.0f;
+		if (!window.empty())
+			local_min_dist =
+			  std::min(local_min_dist, succ_dists[window.front()]);
+
+		// This frame is a successor candidate for its predecessors
+		while (!window.empty() &&
+		       succ_dists[window.back()] >= succ_dists[img_ID])
+			window.pop_back();
+		window.push_back(img_ID);
+
+		// @todo what operation do we do here???
+		dists[img_ID] = dists[img_ID] * local_min_dist;
+	}
+}
+
+void
+KeywordRanker::precompute_projections()
+{
+	info("precomputing keyword embeddings");
 
-		// Compute self distance
-		// Get cosine distance and scale it to [0.0f, 1.0f]
-		float dist_i_succ = dist_cache[query_idx][img_it->frame_ID];
-		// If not yet cached
-		if (std::isnan(dist_i_succ)) {
-			dist_i_succ =
-			  d_cos_normalized(queries[query_idx],
-			                   features.fv(img_it->frame_ID),
-			                   queries[query_idx].size()) /
-			  2.0f;
-			dist_cache[query_idx][img_it->frame_ID] = dist_i_succ;
+	kw_projected = nullptr;
+	kw_projected_data.resize(kw_num_rows * kw_pca_dim);
+
+	size_t n_threads = std::thread::hardware_concurrency();
+	if (n_threads == 0)
+		n_threads = 1;
+	std::vector<std::thread> threads(n_threads);
+
+	auto worker = [&](size_t threadID) {
+		const KeywordId first = threadID * kw_num_rows / n_threads;
+		const KeywordId last = (threadID + 1) * kw_num_rows / n_threads;
+
+		for (KeywordId ID = first; ID < last; ++ID) {
+			FeatureVector v = embed_keywords({ ID });
+			std::copy(v.begin(),
+			          v.end(),
+			          kw_projected_data.begin() + ID * kw_pca_dim);
 		}
+	};
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i] = std::thread(worker, i);
+	for (auto &t : threads)
+		t.join();
+
+	kw_projected = kw_projected_data.data();
+
+	info("keyword embeddings precomputed");
+}
 
-		// Recurse on next queries, this call wil adjust `dist_i_succ`
-		apply_temp_queries(dist_cache,
-		                   img_it->frame_ID,
-		                   queries,
-		                   query_idx + 1,
-		                   dist_i_succ,
-		                   features,
-		                   frames);
-
-		// Update minimum
-		local_min_dist = std::min(local_min_dist, dist_i_succ);
+FeatureVector
+KeywordRanker::embed_keywords(const std::vector<KeywordId> &kw_IDs) const
+{
+	StageTimer timer(Stage::KeywordEmbed);
+
+	// Single keywords are often precomputed
+	if (kw_projected != nullptr && kw_IDs.size() == 1) {
+		const float *p_vec = kw_projected + kw_IDs.front() * kw_pca_dim;
+		return FeatureVector(p_vec, p_vec + kw_pca_dim);
 	}
 
-	// Write new dist to the parameter value
-	// @todo what operation do we do here???
-	result_dist = result_dist * local_min_dist;
+	// Initialize zero vector
+	std::vector<float> score_vec(kw_features_dim, 0.0f);
+
+	// Accumuate scores for given keywords
+	for (auto &&ID : kw_IDs)
+		v_add(score_vec.data(),
+		      kw_features + ID * kw_features_dim,
+		      kw_features_dim);
+
+	// Add bias and apply hyperbolic tangent function
+	v_add_tanh(score_vec.data(), kw_features_bias_vec, kw_features_dim);
+
+	score_vec = VecNorm(score_vec);
+
+	// Subtract PCA mean
+	for (size_t d = 0; d < kw_features_dim; ++d)
+		score_vec[d] -= kw_pca_mean_vec[d];
+
+	// Project it with PCA matrix
+	std::vector<float> sentence_vec(kw_pca_dim);
+	with_dist_kernel<DistKernel::Dot>(kw_features_dim, [&](auto dot) {
+		for (size_t i = 0; i < kw_pca_dim; ++i)
+			sentence_vec[i] = dot(kw_pca_mat + i * kw_features_dim,
+			                      score_vec.data(),
+			                      kw_features_dim);
+	});
+
+	return VecNorm(sentence_vec);
 }
 
-std::vector<std::pair<ImageId, float>>
-KeywordRanker::get_sorted_frames(
+std::vector<float>
+KeywordRanker::get_frame_dists(
   const std::vector<std::vector<KeywordId>> &positive,
   const std::vector<std::vector<KeywordId>> & /*negative*/,
   const DatasetFeatures &features,
   const DatasetFrames &frames,
-  const Config &cfg) const
+  const Config & /*cfg*/) const
 {
-	const size_t result_dim = cfg.kw_PCA_mat_dim;
+	TraceSpan span("KeywordRanker::get_frame_dists");
 
 	std::vector<std::vector<float>> query_vecs;
 
-	for (auto &&kw_IDs : positive) {
-		//
-		// Embed keywords
-		//
-		// Initialize zero vector
-		std::vector<float> score_vec(kw_pca_mean_vec.size(), 0.0f);
+	for (auto &&kw_IDs : positive)
+		query_vecs.emplace_back(embed_keywords(kw_IDs));
 
-		// Accumuate scores for given keywords
-		for (auto &&ID : kw_IDs) {
-			score_vec = VecAdd(score_vec, kw_features[ID]);
-		}
+	if (query_vecs.empty())
+		return std::vector<float>(features.size(), 0.0f);
 
-		// Add bias
-		score_vec = VecAdd(score_vec, kw_features_bias_vec);
-
-		// Apply hyperbolic tangent function
-		std::transform(
-		  score_vec.begin(),
-		  score_vec.end(),
-		  score_vec.begin(),
-		  [](const float &score) { return std::tanh(score); });
-
-		std::vector<float> sentence_vec =
-
-		  MatVecProd(kw_pca_mat,
-		             VecSub(VecNorm(score_vec), kw_pca_mean_vec));
-
-		sentence_vec = VecNorm(sentence_vec);
-
-		query_vecs.emplace_back(std::move(sentence_vec));
+	// To avoid getting stuck in loooooong computation
+	if (query_vecs.size() > MAX_NUM_TEMP_QUERIES + 1)
+		query_vecs.resize(MAX_NUM_TEMP_QUERIES + 1);
+
+	/*
+	 * Evaluate the temporal queries from the last one, each step folds
+	 * the results of the following query into the current one.
+	 */
+	std::vector<float> dists;
+	scan_query_dists(query_vecs.back(), features, dists);
+
+	std::vector<float> succ_dists;
+	for (size_t query_idx = query_vecs.size() - 1; query_idx-- > 0;) {
+		succ_dists.swap(dists);
+		scan_query_dists(query_vecs[query_idx], features, dists);
+		fold_temporal_min(succ_dists, frames, dists);
 	}
 
-	std::vector<std::vector<float>> dist_cache;
-	dist_cache.resize(query_vecs.size(),
-	                  std::vector(features.size(),
-	                              std::numeric_limits<float>::quiet_NaN()));
+	return dists;
+}
 
-	std::vector<std::pair<ImageId, float>> scores;
-	for (size_t img_ID = 0; img_ID < features.size(); ++img_ID) {
-		const float *p_img_fea_vec = features.fv(img_ID);
-
-		// Get cosine distance and scale it to [0.0f, 1.0f]
-		float dist = dist_cache[0][img_ID];
-		// If not yet cached
-		if (std::isnan(dist)) {
-			dist = d_cos_normalized(query_vecs.front(),
-			                        p_img_fea_vec,
-			                        result_dim) /
-			       2.0f;
-			dist_cache[0][img_ID] = dist;
-		} else {
-			std::cout << "cached" << std::endl;
-			;
-		}
+std::vector<std::pair<ImageId, float>>
+KeywordRanker::get_sorted_frames(
+  const std::vector<std::vector<KeywordId>> &positive,
+  const std::vector<std::vector<KeywordId>> &negative,
+  const DatasetFeatures &features,
+  const DatasetFrames &frames,
+  const Config &cfg) const
+{
+	TraceSpan span("KeywordRanker::get_sorted_frames");
 
-		// This will adjust `dist` based on temporal queries
-		apply_temp_queries(
-		  dist_cache, img_ID, query_vecs, 1, dist, features, frames);
+	std::vector<float> dists =
+	  get_frame_dists(positive, negative, features, frames, cfg);
 
-		scores.emplace_back(ImageId(img_ID), dist);
-	}
+	std::vector<std::pair<ImageId, float>> scores;
+	scores.reserve(dists.size());
+	for (ImageId img_ID = 0; img_ID < dists.size(); ++img_ID)
+		scores.emplace_back(img_ID, dists[img_ID]);
 
 	// Sort results
 	std::sort(scores.begin(),
@@ -30,6 +30,7 @@
 #include <vector>
 
 #include "DatasetFrames.h"
+#include "MappedFile.h"
 #include "RelevanceScores.h"
 #include "common.h"
 #include "config_json.h"
@@ -49,49 +50,62 @@ struct Keyword
 class KeywordRanker
 {
 	std::vector<Keyword> keywords;
-	FeatureMatrix kw_features;
-	FeatureVector kw_features_bias_vec;
-	FeatureMatrix kw_pca_mat;
-	FeatureVector kw_pca_mean_vec;
+
+	size_t kw_features_dim{};
+	size_t kw_pca_dim{};
+
+	/** Memory mapped keyword model bundle (if configured) */
+	MappedFile kw_bundle;
+	/** Keyword model parsed from the separate files (otherwise) */
+	std::vector<float> kw_model_data;
+
+	/*
+	 * Row-major model matrices, they point either into `kw_bundle` or
+	 * into `kw_model_data`.
+	 */
+	const float *kw_features{ nullptr };
+	const float *kw_features_bias_vec{ nullptr };
+	const float *kw_pca_mat{ nullptr };
+	const float *kw_pca_mean_vec{ nullptr };
+
+	/** Number of `kw_features` rows, they are indexed by keyword ID */
+	size_t kw_num_rows{};
+
+	/**
+	 * Final embeddings of single keyword queries (kw_num_rows x
+	 * kw_pca_dim) or null if not precomputed. Points either into
+	 * `kw_bundle` or into `kw_projected_data`.
+	 */
+	const float *kw_projected{ nullptr };
+	std::vector<float> kw_projected_data;
 
 public:
 	static std::vector<Keyword> parse_kw_classes_text_file(
 	  const std::string &filepath);
 
 	/**
-	 * Parses float matrix from a binary file that is written in row-major
-	 * format and starts at `begin_offset` offset.k FORMAT: Matrix of 4B
-	 * floats, row - major:
-	 *    - each line is dim_N * 4B floats
-	 *    - number of lines is number of selected frames
+	 * Reads `num_rows` rows of row-major 4B float matrix from a binary
+	 * file that starts at `begin_offset` offset into `dst`.
+	 *    - each line is row_dim * 4B floats
+	 *
+	 * If `num_rows` is 0, all whole rows in the file are read.
+	 *
+	 * Returns the number of rows read.
 	 */
-	// @todo Make this template and inside some `Parsers` class
-	static FeatureMatrix parse_float_matrix(const std::string &filepath,
-	                                        size_t row_dim,
-	                                        size_t begin_offset = 0);
+	static size_t read_float_matrix(const std::string &filepath,
+	                                size_t row_dim,
+	                                std::vector<float> &dst,
+	                                size_t num_rows = 0,
+	                                size_t begin_offset = 0);
+
 	/**
-	 * FORMAT:
-	 *    Matrix of 4B floats:
-	 *    - each line is dim * 4B floats
-	 *    - number of lines is number of selected frames
+	 * Converts the keyword model files from the config into a single
+	 * binary bundle (see `kw_bundle.h`).
 	 */
-	// @todo Make this template and inside some `Parsers` class
-	static FeatureVector parse_float_vector(const std::string &filepath,
-	                                        size_t dim,
-	                                        size_t begin_offset = 0);
-
-	inline KeywordRanker(const Config &config)
-	  : keywords(parse_kw_classes_text_file(config.kws_file))
-	  , kw_features(parse_float_matrix(config.kw_scores_mat_file,
-	                                   config.pre_PCA_features_dim))
-	  , kw_features_bias_vec(
-	      parse_float_vector(config.kw_bias_vec_file,
-	                         config.pre_PCA_features_dim))
-	  , kw_pca_mat(parse_float_matrix(config.kw_PCA_mat_file,
-	                                  config.pre_PCA_features_dim))
-	  , kw_pca_mean_vec(parse_float_vector(config.kw_bias_vec_file,
-	                                       config.pre_PCA_features_dim))
-	{}
+	static void write_kw_bundle(const Config &config,
+	                            const std::string &out_filepath);
+
+	KeywordRanker(const Config &config);
 
 	KeywordRanker(const KeywordRanker &) = delete;
 	KeywordRanker &operator=(const KeywordRanker &) = delete;
@@ -126,13 +140,53 @@ public:
 	                         const Config &cfg) const;
 
 private:
-	void apply_temp_queries(std::vector<std::vector<float>> &dist_cache,
-	                        ImageId img_ID,
-	                        const FeatureMatrix &queries,
-	                        size_t query_idx,
-	                        float &result_dist,
-	                        const DatasetFeatures &features,
-	                        const DatasetFrames &frames) const;
+	/** Loads the model from the separate files given by the config */
+	void load_kw_files(const Config &config);
+
+	/** Maps the binary model bundle */
+	void load_kw_bundle(const std::string &filepath, const Config &config);
+
+	/**
+	 * Computes the embeddings of all single keyword queries into
+	 * `kw_projected_data`.
+	 */
+	void precompute_projections();
+
+	/** Embeds the keywords into the frame feature space */
+	FeatureVector embed_keywords(
+	  const std::vector<KeywordId> &kw_IDs) const;
+
+	/**
+	 * Computes distances of all frames from the given query vector.
+	 *
+	 * Distance is cosine distance scaled to [0, 1].
+	 */
+	static void scan_query_dists(const FeatureVector &query,
+	                             const DatasetFeatures &features,
+	                             std::vector<float> &dists);
+
+	/**
+	 * Multiplies each `dists[i]` by the minimum of `succ_dists` over the
+	 * next `KW_TEMPORAL_SPAN` frames from the same video (or by 1.0 if
+	 * there are none).
+	 *
+	 * This is one step of the temporal query evaluation, minimum is
+	 * maintained with a sliding window over each video.
+	 */
+	static void fold_temporal_min(const std::vector<float> &succ_dists,
+	                              const DatasetFrames &frames,
+	                              std::vector<float> &dists);
+
+	/**
+	 * Computes distances of all frames from the (possibly temporal)
+	 * query in the frame order.
+	 */
+	std::vector<float> get_frame_dists(
+	  const std::vector<std::vector<KeywordId>> &positive,
+	  const std::vector<std::vector<KeywordId>> &negative,
+	  const DatasetFeatures &features,
+	  const DatasetFrames &frames,
+	  const Config &cfg) const;
 
 	/**
 	 * Sorts all images based on provided query and retrieves vector
@@ -0,0 +1,173 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "MappedFile.h"
+
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "log.h"
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &filepath)
+{
+	HANDLE file = CreateFileA(filepath.c_str(),
+	                          GENERIC_READ,
+	                          FILE_SHARE_READ,
+	                          nullptr,
+	                          OPEN_EXISTING,
+	                          FILE_ATTRIBUTE_NORMAL,
+	                          nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Error opening file: " + filepath);
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file);
+		throw std::runtime_error("Empty file opened: " + filepath);
+	}
+
+	HANDLE mapping =
+	  CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		CloseHandle(file);
+		throw std::runtime_error("Error mapping file: " + filepath);
+	}
+
+	void *p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (p == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		throw std::runtime_error("Error mapping file: " + filepath);
+	}
+
+	_data = static_cast<const char *>(p);
+	_size = size_t(size.QuadPart);
+	_file_handle = file;
+	_mapping_handle = mapping;
+}
+
+void
+MappedFile::unmap() noexcept
+{
+	if (_data != nullptr) {
+		UnmapViewOfFile(_data);
+		CloseHandle(_mapping_handle);
+		CloseHandle(_file_handle);
+	}
+
+	_data = nullptr;
+	_size = 0;
+	_file_handle = nullptr;
+	_mapping_handle = nullptr;
+}
+
+void
+MappedFile::evict() const noexcept
+{
+	// Unlocking pages that are not locked removes them from the working
+	// set
+	if (_data != nullptr)
+		VirtualUnlock(const_cast<char *>(_data), _size);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &filepath)
+{
+	int fd = open(filepath.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("Error opening file: " + filepath);
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		throw std::runtime_error("Empty file opened: " + filepath);
+	}
+
+	void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+	// The mapping keeps its own reference to the file
+	close(fd);
+
+	if (p == MAP_FAILED)
+		throw std::runtime_error("Error mapping file: " + filepath);
+
+	_data = static_cast<const char *>(p);
+	_size = size_t(st.st_size);
+}
+
+void
+MappedFile::unmap() noexcept
+{
+	if (_data != nullptr)
+		munmap(const_cast<char *>(_data), _size);
+
+	_data = nullptr;
+	_size = 0;
+}
+
+void
+MappedFile::evict() const noexcept
+{
+	if (_data != nullptr)
+		madvise(const_cast<char *>(_data), _size, MADV_DONTNEED);
+}
+
+#endif
+
+MappedFile::~MappedFile() noexcept
+{
+	unmap();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+{
+	*this = std::move(other);
+}
+
+MappedFile &
+MappedFile::operator=(MappedFile &&other) noexcept
+{
+	if (this == &other)
+		return *this;
+
+	unmap();
+
+	std::swap(_data, other._data);
+	std::swap(_size, other._size);
+#ifdef _WIN32
+	std::swap(_file_handle, other._file_handle);
+	std::swap(_mapping_handle, other._mapping_handle);
+#endif
+
+	return *this;
+}
@@ -0,0 +1,78 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef mapped_file_h
+#define mapped_file_h
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Read-only memory mapping of a whole file.
+ *
+ * The mapping lives as long as the object does, pointers returned by
+ * `data()` are invalidated by destruction (not by moving).
+ */
+class MappedFile
+{
+	const char *_data{ nullptr };
+	size_t _size{ 0 };
+
+#ifdef _WIN32
+	void *_file_handle{ nullptr };
+	void *_mapping_handle{ nullptr };
+#endif
+
+public:
+	MappedFile() = default;
+	/** Maps the file, throws std::runtime_error on failure */
+	MappedFile(const std::string &filepath);
+	~MappedFile() noexcept;
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	MappedFile(MappedFile &&other) noexcept;
+	MappedFile &operator=(MappedFile &&other) noexcept;
+
+	bool is_mapped() const { return _data != nullptr; }
+
+	const char *data() const { return _data; }
+	size_t size() const { return _size; }
+
+	/**
+	 * Drops the mapped pages from the resident memory of the process,
+	 * they are read from the file again on the next access.
+	 */
+	void evict() const noexcept;
+
+	/** Returns pointer to data at the given byte offset */
+	template<typename T>
+	const T *at(size_t offset) const
+	{
+		return reinterpret_cast<const T *>(_data + offset);
+	}
+
+private:
+	void unmap() noexcept;
+};
+
+#endif
@@ -0,0 +1,184 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "PerfCounters.h"
+
+#include "log.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/** -1 = not tried yet, 0 = not available, 1 = available */
+static std::atomic<int> availability{ -1 };
+
+const char *
+PerfCounters::name(PerfEvent e)
+{
+	switch (e) {
+		case PerfEvent::Cycles:
+			return "cycles";
+		case PerfEvent::Instructions:
+			return "instructions";
+		case PerfEvent::LlcMisses:
+			return "llc_misses";
+		case PerfEvent::BranchMisses:
+			return "branch_misses";
+		default:
+			return "unknown";
+	}
+}
+
+#ifdef __linux__
+
+namespace {
+
+/** Counter group of one thread */
+struct ThreadCounters
+{
+	int fds[NUM_PERF_EVENTS];
+	bool tried{ false };
+	bool open{ false };
+
+	ThreadCounters()
+	{
+		for (int &fd : fds)
+			fd = -1;
+	}
+
+	~ThreadCounters() { close_all(); }
+
+	void close_all()
+	{
+		for (int &fd : fds) {
+			if (fd >= 0)
+				close(fd);
+			fd = -1;
+		}
+		open = false;
+	}
+
+	/** Opens the counters as one group (all or nothing) */
+	bool try_open()
+	{
+		if (tried)
+			return open;
+		tried = true;
+
+		static const uint64_t configs[NUM_PERF_EVENTS] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES,
+			PERF_COUNT_HW_BRANCH_MISSES
+		};
+
+		for (size_t i = 0; i < NUM_PERF_EVENTS; ++i) {
+			perf_event_attr attr;
+			std::memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = configs[i];
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP |
+			                   PERF_FORMAT_TOTAL_TIME_ENABLED |
+			                   PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+			// this thread, any CPU, the first one leads the group
+			int group = i ? fds[0] : -1;
+			fds[i] = int(syscall(
+			  SYS_perf_event_open, &attr, 0, -1, group, 0));
+
+			if (fds[i] < 0) {
+				int err = errno;
+				close_all();
+				if (availability.exchange(0) != 0)
+					warn("Performance counters not "
+					     "available: "
+					     << std::strerror(err));
+				return false;
+			}
+		}
+
+		availability = 1;
+		open = true;
+		return true;
+	}
+
+	bool read(uint64_t (&values)[NUM_PERF_EVENTS])
+	{
+		if (!try_open())
+			return false;
+
+		// nr, time enabled, time running, values
+		uint64_t buf[3 + NUM_PERF_EVENTS];
+		if (::read(fds[0], buf, sizeof(buf)) != ssize_t(sizeof(buf)))
+			return false;
+
+		// scale if the group was multiplexed with other events
+		double scale = buf[2] > 0 ? double(buf[1]) / buf[2] : 1.0;
+		for (size_t i = 0; i < NUM_PERF_EVENTS; ++i)
+			values[i] = uint64_t(buf[3 + i] * scale);
+		return true;
+	}
+};
+
+thread_local ThreadCounters thread_counters;
+
+} // namespace
+
+bool
+PerfCounters::read(uint64_t (&values)[NUM_PERF_EVENTS])
+{
+	return thread_counters.read(values);
+}
+
+#else
+
+bool
+PerfCounters::read(uint64_t (&)[NUM_PERF_EVENTS])
+{
+	return false;
+}
+
+#endif
+
+bool
+PerfCounters::available()
+{
+	if (availability < 0) {
+		uint64_t values[NUM_PERF_EVENTS];
+		if (!read(values))
+			availability = 0;
+	}
+	return availability > 0;
+}
+
+bool
+PerfCounters::enable(bool enable)
+{
+	on = enable && available();
+	return !enable || on;
+}
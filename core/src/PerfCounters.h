@@ -0,0 +1,73 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef perf_counters_h
+#define perf_counters_h
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/** Hardware events counted around the hot kernels */
+enum class PerfEvent
+{
+	Cycles,
+	Instructions,
+	LlcMisses,
+	BranchMisses,
+	NumItems
+};
+
+constexpr size_t NUM_PERF_EVENTS = size_t(PerfEvent::NumItems);
+
+/**
+ * Optional hardware performance counters (perf_event_open on Linux).
+ *
+ * The counters of each thread are opened lazily by its first read. If
+ * they cannot be opened (other OS, no PMU in a VM, perf_event_paranoid)
+ * the counting silently turns into a no-op.
+ */
+class PerfCounters
+{
+	static inline std::atomic<bool> on{ false };
+
+public:
+	static const char *name(PerfEvent e);
+
+	/**
+	 * Switches the counting on/off, returns false if the counters are
+	 * not available (the counting then stays off).
+	 */
+	static bool enable(bool enable);
+
+	static bool enabled() { return on.load(std::memory_order_relaxed); }
+
+	/** Whether the counters can be opened (tried on the calling thread) */
+	static bool available();
+
+	/**
+	 * Reads the counter values of the calling thread, returns false if
+	 * they are not available.
+	 */
+	static bool read(uint64_t (&values)[NUM_PERF_EVENTS]);
+};
+
+#endif
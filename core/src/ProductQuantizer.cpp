@@ -0,0 +1,297 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ProductQuantizer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "distfs.h"
+#include "log.h"
+
+ProductQuantizer::ProductQuantizer(const std::string &filepath,
+                                   size_t n,
+                                   size_t dim)
+  : file(filepath)
+  , n(n)
+  , dim(dim)
+{
+	auto invalid = [&filepath](const std::string &why) {
+		std::string msg{ "Invalid PQ codes file " + filepath + ": " +
+			         why };
+		warn(msg);
+		return std::runtime_error(msg);
+	};
+
+	if (file.size() < sizeof(PqCodesHeader))
+		throw invalid("too short");
+
+	const auto &hdr = *file.at<PqCodesHeader>(0);
+
+	if (std::memcmp(hdr.magic, PQ_CODES_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.header_size != sizeof(PqCodesHeader))
+		throw invalid("bad header");
+	if (hdr.version != PQ_CODES_VERSION)
+		throw invalid("unsupported version");
+	if (hdr.num_frames != n || hdr.dim != dim)
+		throw invalid("does not match the dataset");
+	if (hdr.num_subspaces == 0 || dim % hdr.num_subspaces != 0)
+		throw invalid("bad number of subspaces");
+
+	m = hdr.num_subspaces;
+	dsub = dim / m;
+
+	if (hdr.codebooks_off % alignof(float) != 0 ||
+	    hdr.codebooks_off + sizeof(float) * m * PQ_NUM_CENTROIDS * dsub >
+	      hdr.codes_off ||
+	    hdr.codes_off + n * m > file.size())
+		throw invalid("bad section offsets");
+
+	codebooks = file.at<float>(hdr.codebooks_off);
+	codes = file.at<uint8_t>(hdr.codes_off);
+
+	info("Loaded PQ codes with " << m << " subspaces");
+}
+
+void
+ProductQuantizer::dot_table(const float *query, float *table) const
+{
+	const float *centroid = codebooks;
+	for (size_t j = 0; j < m; ++j, query += dsub)
+		for (size_t c = 0; c < PQ_NUM_CENTROIDS; ++c, centroid += dsub)
+			*table++ = d_dot(query, centroid, dsub);
+}
+
+void
+ProductQuantizer::adc_all(const float *table, float *res) const
+{
+	for (size_t i = 0; i < n; ++i)
+		res[i] = adc(table, i);
+}
+
+void
+ProductQuantizer::decode(size_t i, float *out) const
+{
+	const uint8_t *code = codes + m * i;
+	const float *subspace = codebooks;
+	for (size_t j = 0; j < m; ++j, subspace += PQ_NUM_CENTROIDS * dsub)
+		out = std::copy_n(subspace + code[j] * dsub, dsub, out);
+}
+
+float
+ProductQuantizer::dot(const float *query, size_t i) const
+{
+	const uint8_t *code = codes + m * i;
+	const float *subspace = codebooks;
+	float res = 0;
+	for (size_t j = 0; j < m; ++j, subspace += PQ_NUM_CENTROIDS * dsub)
+		res += d_dot(query + j * dsub, subspace + code[j] * dsub, dsub);
+	return res;
+}
+
+/** Index of the centroid nearest to the subvector */
+static uint8_t
+nearest_centroid(const float *v, const float *centroids, size_t dsub)
+{
+	size_t nearest = 0;
+	float nearestd = d_sqeucl(v, centroids, dsub);
+	for (size_t c = 1; c < PQ_NUM_CENTROIDS; ++c) {
+		float d = d_sqeucl(v, centroids + c * dsub, dsub);
+		if (d < nearestd) {
+			nearest = c;
+			nearestd = d;
+		}
+	}
+	return uint8_t(nearest);
+}
+
+/** Lloyd's k-means of the sample subvectors at offset `off` */
+static void
+train_subspace(const float *points,
+               size_t dim,
+               size_t off,
+               size_t dsub,
+               const std::vector<size_t> &sample,
+               size_t iters,
+               float *centroids,
+               std::mt19937 &rng)
+{
+	const size_t k = PQ_NUM_CENTROIDS;
+	std::uniform_int_distribution<size_t> random_point(0,
+	                                                   sample.size() - 1);
+	auto subvector = [&](size_t s) {
+		return points + dim * sample[s] + off;
+	};
+
+	for (size_t c = 0; c < k; ++c)
+		std::copy_n(
+		  subvector(random_point(rng)), dsub, centroids + c * dsub);
+
+	std::vector<uint8_t> assignment(sample.size());
+	std::vector<float> sums(k * dsub);
+	std::vector<size_t> counts(k);
+
+	for (size_t it = 0; it < iters; ++it) {
+		for (size_t s = 0; s < sample.size(); ++s)
+			assignment[s] =
+			  nearest_centroid(subvector(s), centroids, dsub);
+
+		std::fill(sums.begin(), sums.end(), 0.0f);
+		std::fill(counts.begin(), counts.end(), 0);
+		for (size_t s = 0; s < sample.size(); ++s) {
+			const float *v = subvector(s);
+			float *sum = sums.data() + assignment[s] * dsub;
+			for (size_t d = 0; d < dsub; ++d)
+				sum[d] += v[d];
+			++counts[assignment[s]];
+		}
+
+		for (size_t c = 0; c < k; ++c) {
+			float *centroid = centroids + c * dsub;
+			// Reseed the empty clusters
+			if (counts[c] == 0) {
+				std::copy_n(
+				  subvector(random_point(rng)), dsub, centroid);
+				continue;
+			}
+			for (size_t d = 0; d < dsub; ++d)
+				centroid[d] = sums[c * dsub + d] / counts[c];
+		}
+	}
+}
+
+void
+ProductQuantizer::train_and_write(const float *points,
+                                  size_t n,
+                                  size_t dim,
+                                  size_t num_subspaces,
+                                  size_t iters,
+                                  size_t sample_size,
+                                  const std::string &out_filepath)
+{
+	if (n == 0)
+		throw std::runtime_error("No points to quantize");
+	if (num_subspaces == 0 || dim % num_subspaces != 0)
+		throw std::runtime_error(
+		  "The dimension is not divisible by the number of subspaces");
+
+	const size_t m = num_subspaces, dsub = dim / m;
+	size_t n_threads =
+	  std::max<size_t>(1, std::thread::hardware_concurrency());
+
+	// Deterministic training sample
+	std::mt19937 rng(0);
+	std::vector<size_t> sample(n);
+	std::iota(sample.begin(), sample.end(), 0);
+	std::shuffle(sample.begin(), sample.end(), rng);
+	sample.resize(std::min(sample_size, n));
+
+	info("Training PQ codebooks on " << sample.size() << " points");
+
+	std::vector<float> codebooks(m * PQ_NUM_CENTROIDS * dsub);
+	auto codebook = [&](size_t j) {
+		return codebooks.data() + j * PQ_NUM_CENTROIDS * dsub;
+	};
+	{
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < std::min(n_threads, m); ++t)
+			threads.emplace_back([&, t]() {
+				for (size_t j = t; j < m; j += n_threads) {
+					std::mt19937 sub_rng(j);
+					train_subspace(points,
+					               dim,
+					               j * dsub,
+					               dsub,
+					               sample,
+					               iters,
+					               codebook(j),
+					               sub_rng);
+				}
+			});
+		for (auto &t : threads)
+			t.join();
+	}
+
+	info("Encoding " << n << " points");
+
+	std::vector<uint8_t> codes(n * m);
+	{
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < n_threads; ++t)
+			threads.emplace_back([&, t]() {
+				size_t first = t * n / n_threads;
+				size_t last = (t + 1) * n / n_threads;
+				for (size_t i = first; i < last; ++i)
+					for (size_t j = 0; j < m; ++j)
+						codes[i * m + j] =
+						  nearest_centroid(
+						    points + i * dim + j * dsub,
+						    codebook(j),
+						    dsub);
+			});
+		for (auto &t : threads)
+			t.join();
+	}
+
+	auto align = [](uint64_t off) {
+		return (off + PQ_CODES_ALIGN - 1) / PQ_CODES_ALIGN *
+		       PQ_CODES_ALIGN;
+	};
+
+	PqCodesHeader hdr{};
+	std::memcpy(hdr.magic, PQ_CODES_MAGIC, sizeof(hdr.magic));
+	hdr.version = PQ_CODES_VERSION;
+	hdr.header_size = sizeof(PqCodesHeader);
+	hdr.num_frames = n;
+	hdr.dim = uint32_t(dim);
+	hdr.num_subspaces = uint32_t(m);
+	hdr.codebooks_off = align(sizeof(PqCodesHeader));
+	hdr.codes_off =
+	  align(hdr.codebooks_off + sizeof(float) * codebooks.size());
+	hdr.file_size = hdr.codes_off + codes.size();
+
+	std::ofstream ofs(out_filepath, std::ios::binary | std::ios::trunc);
+	if (!ofs)
+		throw std::runtime_error("Error opening file: " + out_filepath);
+
+	auto write_at = [&ofs](uint64_t off, const void *p, uint64_t len) {
+		// Pad up to the section offset
+		static const char zeros[PQ_CODES_ALIGN]{};
+		ofs.write(zeros, off - uint64_t(ofs.tellp()));
+
+		ofs.write(static_cast<const char *>(p), len);
+	};
+
+	write_at(0, &hdr, sizeof(hdr));
+	write_at(hdr.codebooks_off,
+	         codebooks.data(),
+	         sizeof(float) * codebooks.size());
+	write_at(hdr.codes_off, codes.data(), codes.size());
+
+	if (!ofs)
+		throw std::runtime_error("Error writing file: " + out_filepath);
+}
@@ -0,0 +1,92 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef product_quantizer_h
+#define product_quantizer_h
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "MappedFile.h"
+#include "pq_codes.h"
+
+/**
+ * Product-quantized codes of the feature matrix (see `pq_codes.h`).
+ *
+ * The distances of a query to the codes are sums of per-subspace lookups
+ * into a per-query table (asymmetric distance computation), the table
+ * has `table_size()` floats.
+ */
+class ProductQuantizer
+{
+	MappedFile file;
+	size_t n{ 0 }, dim{ 0 }, m{ 0 }, dsub{ 0 };
+	const float *codebooks{ nullptr };
+	const uint8_t *codes{ nullptr };
+
+public:
+	ProductQuantizer() = default;
+	/**
+	 * Maps the codes file, throws std::runtime_error if it is invalid or
+	 * does not match the dataset size.
+	 */
+	ProductQuantizer(const std::string &filepath, size_t n, size_t dim);
+
+	size_t num_subspaces() const { return m; }
+	size_t table_size() const { return m * PQ_NUM_CENTROIDS; }
+
+	/** Fills the table with the dot products of the query subvectors */
+	void dot_table(const float *query, float *table) const;
+
+	/** Approximate dot product of the query (given by its table) */
+	inline float adc(const float *table, size_t i) const
+	{
+		const uint8_t *code = codes + m * i;
+		float res = 0;
+		for (size_t j = 0; j < m; ++j, table += PQ_NUM_CENTROIDS)
+			res += table[code[j]];
+		return res;
+	}
+
+	/** `adc` of all the frames, written into `res` */
+	void adc_all(const float *table, float *res) const;
+
+	/** Writes the reconstruction of the frame (its centroids) to `out` */
+	void decode(size_t i, float *out) const;
+
+	/** Dot product of the query and the reconstruction of the frame */
+	float dot(const float *query, size_t i) const;
+
+	/**
+	 * Trains the codebooks with k-means on (a sample of) the points,
+	 * encodes all of them and writes the codes file.
+	 */
+	static void train_and_write(const float *points,
+	                            size_t n,
+	                            size_t dim,
+	                            size_t num_subspaces,
+	                            size_t iters,
+	                            size_t sample_size,
+	                            const std::string &out_filepath);
+};
+
+#endif // product_quantizer_h
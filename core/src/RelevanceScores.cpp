@@ -30,6 +30,8 @@
 #include <thread>
 #include <vector>
 
+#include "StageStats.h"
+#include "Trace.h"
 #include "log.h"
 
 #define MINIMAL_SCORE 1e-12f
@@ -101,6 +103,8 @@ ScoreModel::top_n_with_context(const DatasetFrames &frames,
                                size_t from_vid_limit,
                                size_t from_shot_limit) const
 {
+	TraceSpan span("ScoreModel::top_n_with_context");
+
 	/* This display needs to have `GUI_IMG_GRID_WIDTH`-times more images
 	if we want to keep reporting `n` unique results. */
 	n = n * DISPLAY_GRID_WIDTH;
@@ -131,6 +135,8 @@ ScoreModel::top_n(const DatasetFrames &frames,
                   size_t from_vid_limit,
                   size_t from_shot_limit) const
 {
+	StageTimer timer(Stage::TopN);
+
 	if (from_vid_limit == 0)
 		from_vid_limit = scores.size();
 
@@ -148,21 +154,21 @@ ScoreModel::top_n(const DatasetFrames &frames,
 	std::sort(
 	  score_ids.begin(), score_ids.end(), std::greater<FrameScoreIdPair>());
 
-	std::map<VideoId, size_t> frames_per_vid;
-	std::map<VideoId, std::map<ShotId, size_t>> frames_per_shot;
+	const VideoId *video_IDs = frames.video_IDs();
+	std::vector<size_t> frames_per_vid(frames.get_num_videos(), 0);
+	std::vector<size_t> frames_per_shot(frames.get_num_shots(), 0);
 	std::vector<ImageId> result;
 	result.reserve(n);
 	size_t t = 0;
 	for (ImageId i = 0; t < n && i < scores.size(); ++i) {
 		ImageId frame = score_ids[i].id;
-		auto vf = frames.get_frame(frame);
 
 		// If we have already enough from this video
-		if (frames_per_vid[vf.video_ID]++ >= from_vid_limit)
+		if (frames_per_vid[video_IDs[frame]]++ >= from_vid_limit)
 			continue;
 
 		// If we have already enough from this shot
-		if (frames_per_shot[vf.video_ID][vf.shot_ID]++ >=
+		if (frames_per_shot[frames.get_shot_index(frame)]++ >=
 		    from_shot_limit)
 			continue;
 
@@ -175,6 +181,8 @@ ScoreModel::top_n(const DatasetFrames &frames,
 std::vector<ImageId>
 ScoreModel::weighted_sample(size_t k, float pow) const
 {
+	TraceSpan span("ScoreModel::weighted_sample");
+
 	size_t n = scores.size();
 
 	assert(n >= 2);
@@ -261,6 +269,8 @@ ScoreModel::apply_bayes(std::set<ImageId> likes,
 	if (likes.empty())
 		return;
 
+	StageTimer timer(Stage::Bayes);
+
 	constexpr float Sigma = .25f;
 	constexpr size_t max_others = 64;
 
@@ -291,21 +301,27 @@ ScoreModel::apply_bayes(std::set<ImageId> likes,
 		std::vector<std::thread> threads(n_threads);
 
 		auto worker = [&](size_t threadID) {
+			PerfScope perf(Stage::Bayes);
+
 			const ImageId first =
 			  threadID * scores.size() / n_threads;
 			const ImageId last =
 			  (threadID + 1) * scores.size() / n_threads;
 
+			// the frame is decoded once for all the comparisons
+			std::vector<float> buf(features.dim());
+
 			for (ImageId ii = first; ii < last; ++ii) {
+				const float *fv = features.row(ii, buf.data());
 				float divSum = 0;
 
 				for (ImageId oi : others)
 					divSum +=
-					  expf(-features.d_dot(ii, oi) / Sigma);
+					  expf(-features.d_dot(fv, oi) / Sigma);
 
 				for (auto &&like : likes) {
 					const float likeValTmp = expf(
-					  -features.d_dot(ii, like) / Sigma);
+					  -features.d_dot(fv, like) / Sigma);
 					scores[ii] *=
 					  likeValTmp / (likeValTmp + divSum);
 				}
@@ -327,6 +343,8 @@ ScoreModel::apply_bayes(std::set<ImageId> likes,
 void
 ScoreModel::normalize()
 {
+	TraceSpan span("ScoreModel::normalize");
+
 	float smax = 0;
 
 	for (float s : scores)
@@ -346,6 +364,16 @@ ScoreModel::normalize()
 	}
 }
 
+void
+ScoreModel::adjust_exp(const std::vector<float> &dists, float scale)
+{
+	TraceSpan span("ScoreModel::adjust_exp");
+
+	assert(dists.size() == scores.size());
+
+	v_mul_exp(scores.data(), dists.data(), scale, scores.size());
+}
+
 size_t
 ScoreModel::rank_of_image(ImageId i) const
 {
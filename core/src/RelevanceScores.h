@@ -53,6 +53,12 @@ public:
 	size_t size() const { return scores.size(); }
 	void normalize();
 
+	/**
+	 * Multiplies the score of each image by `exp(dists[i] * scale)`,
+	 * `dists` must be indexed by image IDs.
+	 */
+	void adjust_exp(const std::vector<float> &dists, float scale);
+
 	/**
 	 * Applies relevance feedback based on
 	 * bayesian update rule.
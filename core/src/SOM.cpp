@@ -22,21 +22,11 @@
 #include "SOM.h"
 
 #include <cmath>
+#include <stdexcept>
 
-#include "distfs.h"
+#include "distfs16.h"
 #include "log.h"
 
-// uncomment to get euclidean distances
-#define EUCL
-
-#ifdef EUCL
-#define DIST_FUNC d_sqeucl
-#define UNDIST_FUNC sqrtf
-#else
-#define DIST_FUNC d_manhattan
-#define UNDIST_FUNC
-#endif
-
 // this helps with debugging floating-point overflows and similar nastiness,
 // uncomment if needed.
 //#define DEBUG_CRASH_ON_FPE
@@ -100,25 +90,65 @@ heap_down(dist_id *heap, size_t start, size_t lim)
 	}
 }
 
-void
-som(size_t /*n*/,
-    size_t k,
-    size_t dim,
-    size_t niter,
-    const std::vector<float> &points,
-    std::vector<float> &koho,
-    const std::vector<float> &nhbrdist,
-    const float alphasA[2],
-    const float radiiA[2],
-    const float alphasB[2],
-    const float radiiB[2],
-    const std::vector<float> &scores,
-    std::mt19937 &rng)
+DistKernel
+parse_som_distance(const std::string &name)
+{
+	if (name.empty() || name == "eucl")
+		return DistKernel::SqEucl;
+	if (name == "manhattan")
+		return DistKernel::Manhattan;
+
+	std::string msg{ "Unknown SOM distance: " + name };
+	warn(msg);
+	throw std::runtime_error(msg);
+}
+
+/*
+ * Rows of the points as floats, the halves are widened (and the other
+ * rows decoded) into the buffer once per row, the row is then compared
+ * to all the neurons
+ */
+static inline const float *
+point_row(const float *points, size_t dim, size_t i, float *)
+{
+	return points + dim * i;
+}
+
+static inline const float *
+point_row(const uint16_t *points, size_t dim, size_t i, float *buf)
+{
+	half_to_float(points + dim * i, buf, dim);
+	return buf;
+}
+
+static inline const float *
+point_row(const PointRows *points, size_t, size_t i, float *buf)
+{
+	return (*points)(i, buf);
+}
+
+template<typename T, typename Dist>
+static void
+som_impl(size_t k,
+         size_t dim,
+         size_t niter,
+         const T *points,
+         std::vector<float> &koho,
+         const std::vector<float> &nhbrdist,
+         const float alphasA[2],
+         const float radiiA[2],
+         const float alphasB[2],
+         const float radiiB[2],
+         const std::vector<float> &scores,
+         std::mt19937 &rng,
+         Dist dist)
 {
 	info("build begin");
 	std::discrete_distribution<size_t> random(scores.begin(), scores.end());
 	info("build end");
 
+	std::vector<float> buf(dim);
+
 	float thresholdA0 = radiiA[0];
 	float alphaA0 = alphasA[0];
 	float thresholdADiff = radiiA[1] - radiiA[0];
@@ -131,16 +161,13 @@ som(size_t /*n*/,
 	for (size_t iter = 0; iter < niter; ++iter) {
 		size_t point = random(rng);
 		float riter = iter / float(niter);
+		const float *p = point_row(points, dim, point, buf.data());
 
 		size_t nearest = 0;
 		{
-			float nearestd = DIST_FUNC(
-			  points.data() + dim * point, koho.data(), dim);
+			float nearestd = dist(p, koho.data(), dim);
 			for (size_t i = 1; i < k; ++i) {
-				float tmp =
-				  DIST_FUNC(points.data() + dim * point,
-				            koho.data() + dim * i,
-				            dim);
+				float tmp = dist(p, koho.data() + dim * i, dim);
 				if (tmp < nearestd) {
 					nearest = i;
 					nearestd = tmp;
@@ -167,29 +194,130 @@ som(size_t /*n*/,
 
 			for (size_t j = 0; j < dim; ++j)
 				koho[j + i * dim] +=
-				  alpha *
-				  (points[j + point * dim] - koho[j + i * dim]);
+				  alpha * (p[j] - koho[j + i * dim]);
 		}
 	}
 }
 
-/* this serves for classification into small clusters */
 void
-mapPointsToKohos(size_t n,
-                 size_t k,
-                 size_t dim,
-                 const std::vector<float> &points,
-                 const std::vector<float> &koho,
-                 std::vector<size_t> &mapping)
+som(size_t /*n*/,
+    size_t k,
+    size_t dim,
+    DistKernel distance,
+    size_t niter,
+    const float *points,
+    std::vector<float> &koho,
+    const std::vector<float> &nhbrdist,
+    const float alphasA[2],
+    const float radiiA[2],
+    const float alphasB[2],
+    const float radiiB[2],
+    const std::vector<float> &scores,
+    std::mt19937 &rng)
+{
+	with_dist_kernel(distance, dim, [&](auto dist) {
+		som_impl(k,
+		         dim,
+		         niter,
+		         points,
+		         koho,
+		         nhbrdist,
+		         alphasA,
+		         radiiA,
+		         alphasB,
+		         radiiB,
+		         scores,
+		         rng,
+		         dist);
+	});
+}
+
+void
+som(size_t /*n*/,
+    size_t k,
+    size_t dim,
+    DistKernel distance,
+    size_t niter,
+    const uint16_t *points,
+    std::vector<float> &koho,
+    const std::vector<float> &nhbrdist,
+    const float alphasA[2],
+    const float radiiA[2],
+    const float alphasB[2],
+    const float radiiB[2],
+    const std::vector<float> &scores,
+    std::mt19937 &rng)
+{
+	with_dist_kernel(distance, dim, [&](auto dist) {
+		som_impl(k,
+		         dim,
+		         niter,
+		         points,
+		         koho,
+		         nhbrdist,
+		         alphasA,
+		         radiiA,
+		         alphasB,
+		         radiiB,
+		         scores,
+		         rng,
+		         dist);
+	});
+}
+
+void
+som(size_t /*n*/,
+    size_t k,
+    size_t dim,
+    DistKernel distance,
+    size_t niter,
+    const PointRows &points,
+    std::vector<float> &koho,
+    const std::vector<float> &nhbrdist,
+    const float alphasA[2],
+    const float radiiA[2],
+    const float alphasB[2],
+    const float radiiB[2],
+    const std::vector<float> &scores,
+    std::mt19937 &rng)
+{
+	with_dist_kernel(distance, dim, [&](auto dist) {
+		som_impl(k,
+		         dim,
+		         niter,
+		         &points,
+		         koho,
+		         nhbrdist,
+		         alphasA,
+		         radiiA,
+		         alphasB,
+		         radiiB,
+		         scores,
+		         rng,
+		         dist);
+	});
+}
+
+/* this serves for classification into small clusters */
+template<typename T, typename Dist>
+static void
+map_points_impl(size_t n,
+                size_t k,
+                size_t dim,
+                const T *points,
+                const std::vector<float> &koho,
+                std::vector<size_t> &mapping,
+                Dist dist)
 {
+	std::vector<float> buf(dim);
+
 	for (size_t point = 0; point < n; ++point) {
+		const float *p = point_row(points, dim, point, buf.data());
+
 		size_t nearest = 0;
-		float nearestd =
-		  DIST_FUNC(points.data() + dim * point, koho.data(), dim);
+		float nearestd = dist(p, koho.data(), dim);
 		for (size_t i = 1; i < k; ++i) {
-			float tmp = DIST_FUNC(points.data() + dim * point,
-			                      koho.data() + dim * i,
-			                      dim);
+			float tmp = dist(p, koho.data() + dim * i, dim);
 			if (tmp < nearestd) {
 				nearest = i;
 				nearestd = tmp;
@@ -199,3 +327,45 @@ mapPointsToKohos(size_t n,
 		mapping[point] = nearest;
 	}
 }
+
+void
+mapPointsToKohos(size_t n,
+                 size_t k,
+                 size_t dim,
+                 DistKernel distance,
+                 const float *points,
+                 const std::vector<float> &koho,
+                 std::vector<size_t> &mapping)
+{
+	with_dist_kernel(distance, dim, [&](auto dist) {
+		map_points_impl(n, k, dim, points, koho, mapping, dist);
+	});
+}
+
+void
+mapPointsToKohos(size_t n,
+                 size_t k,
+                 size_t dim,
+                 DistKernel distance,
+                 const uint16_t *points,
+                 const std::vector<float> &koho,
+                 std::vector<size_t> &mapping)
+{
+	with_dist_kernel(distance, dim, [&](auto dist) {
+		map_points_impl(n, k, dim, points, koho, mapping, dist);
+	});
+}
+
+void
+mapPointsToKohos(size_t n,
+                 size_t k,
+                 size_t dim,
+                 DistKernel distance,
+                 const PointRows &points,
+                 const std::vector<float> &koho,
+                 std::vector<size_t> &mapping)
+{
+	with_dist_kernel(distance, dim, [&](auto dist) {
+		map_points_impl(n, k, dim, &points, koho, mapping, dist);
+	});
+}
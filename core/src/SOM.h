@@ -22,15 +22,51 @@
 #ifndef embedsom_h
 #define embedsom_h
 
+#include <cstdint>
+#include <functional>
 #include <random>
+#include <string>
 #include <vector>
 
+#include "distfs.h"
+
+/*
+ * The distance of the points and the neurons is either DistKernel::SqEucl
+ * or DistKernel::Manhattan (parsed from the `som_distance` config).
+ */
+DistKernel
+parse_som_distance(const std::string &name);
+
+/*
+ * Points decoded row by row: returns the row `i` as floats, possibly
+ * written into `buf` of `dim` floats (see DatasetFeatures::row)
+ */
+using PointRows = std::function<const float *(size_t i, float *buf)>;
+
+void
+som(size_t n,
+    size_t k,
+    size_t dim,
+    DistKernel distance,
+    size_t niter,
+    const float *points,
+    std::vector<float> &koho,
+    const std::vector<float> &nhbrdist,
+    const float alphasA[2],
+    const float radiiA[2],
+    const float alphasB[2],
+    const float radiiB[2],
+    const std::vector<float> &scores,
+    std::mt19937 &rng);
+
+/* the same with the points stored as IEEE halves (see distfs16.h) */
 void
 som(size_t n,
     size_t k,
     size_t dim,
+    DistKernel distance,
     size_t niter,
-    const std::vector<float> &points,
+    const uint16_t *points,
     std::vector<float> &koho,
     const std::vector<float> &nhbrdist,
     const float alphasA[2],
@@ -40,11 +76,47 @@ som(size_t n,
     const std::vector<float> &scores,
     std::mt19937 &rng);
 
+/* the same with the points decoded by `points` */
+void
+som(size_t n,
+    size_t k,
+    size_t dim,
+    DistKernel distance,
+    size_t niter,
+    const PointRows &points,
+    std::vector<float> &koho,
+    const std::vector<float> &nhbrdist,
+    const float alphasA[2],
+    const float radiiA[2],
+    const float alphasB[2],
+    const float radiiB[2],
+    const std::vector<float> &scores,
+    std::mt19937 &rng);
+
+void
+mapPointsToKohos(size_t n,
+                 size_t k,
+                 size_t dim,
+                 DistKernel distance,
+                 const float *points,
+                 const std::vector<float> &koho,
+                 std::vector<size_t> &mapping);
+
+void
+mapPointsToKohos(size_t n,
+                 size_t k,
+                 size_t dim,
+                 DistKernel distance,
+                 const uint16_t *points,
+                 const std::vector<float> &koho,
+                 std::vector<size_t> &mapping);
+
 void
 mapPointsToKohos(size_t n,
                  size_t k,
                  size_t dim,
-                 const std::vector<float> &points,
+                 DistKernel distance,
+                 const PointRows &points,
                  const std::vector<float> &koho,
                  std::vector<size_t> &mapping);
 #endif
@@ -22,6 +22,7 @@
 #include <stdexcept>
 
 #include "SomHunter.h"
+#include "Trace.h"
 
 #include "log.h"
 #include "utils.h"
@@ -29,6 +30,8 @@
 FramePointerRange
 SomHunter::get_display(DisplayType d_type, ImageId selected_image, PageId page)
 {
+	TraceSpan span("SomHunter::get_display");
+
 	submitter.poll();
 
 	switch (d_type) {
@@ -71,8 +74,6 @@ SomHunter::add_likes(const std::vector<ImageId> &likes)
 	for (auto ii : likes) {
 		this->likes.insert(ii);
 
-		frames.get_frame(ii).liked = true;
-
 		submitter.log_like(frames, current_display_type, ii);
 	}
 }
@@ -85,8 +86,6 @@ SomHunter::remove_likes(const std::vector<ImageId> &likes)
 	for (auto ii : likes) {
 		this->likes.erase(ii);
 
-		frames.get_frame(ii).liked = false;
-
 		submitter.log_dislike(frames, current_display_type, ii);
 	}
 }
@@ -110,6 +109,8 @@ SomHunter::autocomplete_keywords(const std::string &prefix, size_t count) const
 void
 SomHunter::rescore(const std::string &text_query)
 {
+	TraceSpan span("SomHunter::rescore");
+
 	submitter.poll();
 
 	// Rescore text query
@@ -126,9 +127,6 @@ SomHunter::rescore(const std::string &text_query)
 
 	// Reset likes
 	likes.clear();
-	for (auto &fr : frames) {
-		fr.liked = false;
-	}
 
 	auto top_n = scores.top_n(frames,
 	                          TOPN_LIMIT,
@@ -173,6 +171,8 @@ SomHunter::reset_search_session()
 void
 SomHunter::rescore_keywords(const std::string &query)
 {
+	TraceSpan span("SomHunter::rescore_keywords");
+
 	// Do not rescore if query did not change
 	if (last_text_query == query) {
 		return;
@@ -191,6 +191,8 @@ SomHunter::rescore_keywords(const std::string &query)
 void
 SomHunter::rescore_feedback()
 {
+	TraceSpan span("SomHunter::rescore_feedback");
+
 	if (likes.empty())
 		return;
 
@@ -207,6 +209,8 @@ SomHunter::som_start()
 FramePointerRange
 SomHunter::get_random_display()
 {
+	TraceSpan span("SomHunter::get_random_display");
+
 	// Get ids
 	auto ids = scores.weighted_sample(
 	  DISPLAY_GRID_WIDTH * DISPLAY_GRID_HEIGHT, RANDOM_DISPLAY_WEIGHT);
@@ -225,6 +229,8 @@ SomHunter::get_random_display()
 FramePointerRange
 SomHunter::get_topn_display(PageId page)
 {
+	TraceSpan span("SomHunter::get_topn_display");
+
 	// Another display or first page -> load
 	if (current_display_type != DisplayType::DTopN || page == 0) {
 		debug("Loading top n display first page");
@@ -248,6 +254,8 @@ SomHunter::get_topn_display(PageId page)
 FramePointerRange
 SomHunter::get_topn_context_display(PageId page)
 {
+	TraceSpan span("SomHunter::get_topn_context_display");
+
 	// Another display or first page -> load
 	if (current_display_type != DisplayType::DTopNContext || page == 0) {
 		debug("Loading top n context display first page");
@@ -272,6 +280,8 @@ SomHunter::get_topn_context_display(PageId page)
 FramePointerRange
 SomHunter::get_som_display()
 {
+	TraceSpan span("SomHunter::get_som_display");
+
 	if (!asyncSom.map_ready()) {
 		return FramePointerRange();
 	}
@@ -312,6 +322,8 @@ SomHunter::get_som_display()
 FramePointerRange
 SomHunter::get_video_detail_display(ImageId selected_image)
 {
+	TraceSpan span("SomHunter::get_video_detail_display");
+
 	VideoId v_id = frames.get_video_id(selected_image);
 
 	if (v_id == VIDEO_ID_ERR_VAL) {
@@ -340,6 +352,8 @@ SomHunter::get_video_detail_display(ImageId selected_image)
 FramePointerRange
 SomHunter::get_topKNN_display(ImageId selected_image, PageId page)
 {
+	TraceSpan span("SomHunter::get_topKNN_display");
+
 	// Another display or first page -> load
 	if (current_display_type != DisplayType::DTopKNN || page == 0) {
 		debug("Getting KNN for image " << selected_image);
@@ -410,9 +424,6 @@ SomHunter::reset_scores()
 
 	// Reset likes
 	likes.clear();
-	for (auto &fr : frames) {
-		fr.liked = false;
-	}
 
 	last_text_query = "";
 
@@ -22,26 +22,29 @@
 #ifndef somhunter_h
 #define somhunter_h
 
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
 
 #include "AsyncSom.h"
-#include "DatasetFeatures.h"
-#include "DatasetFrames.h"
-#include "KeywordRanker.h"
+#include "Dataset.h"
 #include "RelevanceScores.h"
 #include "Submitter.h"
 
-/* This is the main backend class. */
+/*
+ * This is the main backend class, one instance holds one search session.
+ * Sessions created from the same `Dataset` share the loaded data.
+ */
 
 class SomHunter
 {
 	// *** LOADED DATASET ***
-	DatasetFrames frames;
-	const DatasetFeatures features;
-	const KeywordRanker keywords;
-	const Config config;
+	const std::shared_ptr<const Dataset> dataset;
+	const DatasetFrames &frames;
+	const DatasetFeatures &features;
+	const KeywordRanker &keywords;
+	const Config &config;
 
 	// *** SEARCH CONTEXT ***
 	// Relevance scores
@@ -67,19 +70,25 @@ class SomHunter
 
 public:
 	SomHunter() = delete;
-	/** The main ctor with the filepath to the JSON config file */
-	inline SomHunter(const Config &cfg)
-	  : config(cfg)
-	  , frames(cfg)
-	  , features(frames, cfg)
+	/** Creates a new search session over the shared dataset */
+	inline SomHunter(std::shared_ptr<const Dataset> ds)
+	  : dataset(std::move(ds))
+	  , frames(dataset->frames)
+	  , features(dataset->features)
+	  , keywords(dataset->keywords)
+	  , config(dataset->config)
 	  , scores(frames)
-	  , keywords(cfg)
-	  , asyncSom(cfg)
-	  , submitter(cfg.submitter_config)
+	  , asyncSom(config)
+	  , submitter(config.submitter_config)
 	{
 		asyncSom.start_work(features, scores);
 	}
 
+	/** Loads the dataset given by the config just for this session */
+	inline SomHunter(const Config &cfg)
+	  : SomHunter(std::make_shared<const Dataset>(cfg))
+	{}
+
 	/** Returns display of desired type
 	 *
 	 *	Some diplays may even support paging (e.g. top_n) or
@@ -93,6 +102,14 @@ public:
 
 	void remove_likes(const std::vector<ImageId> &likes);
 
+	bool is_liked(ImageId frame_ID) const
+	{
+		return likes.find(frame_ID) != likes.end();
+	}
+
+	/** Current relevance score of the frame */
+	float get_score(ImageId frame_ID) const { return scores[frame_ID]; }
+
 	std::vector<const Keyword *> autocomplete_keywords(
 	  const std::string &prefix,
 	  size_t count) const;
@@ -0,0 +1,305 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "StageStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "JsonWriter.h"
+#include "config.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/** Highest power of two with its own buckets, longer runs are clamped */
+constexpr size_t STAGE_HIST_MAX_EXP = 40; // ~18 minutes
+constexpr size_t STAGE_HIST_SUB = size_t(1) << STAGE_HIST_SUB_BITS;
+constexpr size_t STAGE_HIST_BUCKETS =
+  (STAGE_HIST_MAX_EXP - STAGE_HIST_SUB_BITS + 2) * STAGE_HIST_SUB;
+
+static size_t
+bucket_of(uint64_t ns)
+{
+	ns = std::min(ns, (uint64_t(2) << STAGE_HIST_MAX_EXP) - 1);
+	if (ns < STAGE_HIST_SUB)
+		return ns;
+
+#ifdef _MSC_VER
+	unsigned long exp;
+	_BitScanReverse64(&exp, ns);
+#else
+	size_t exp = 63 - __builtin_clzll(ns);
+#endif
+	size_t mantissa = (ns >> (exp - STAGE_HIST_SUB_BITS)) &
+	                  (STAGE_HIST_SUB - 1);
+	return (exp - STAGE_HIST_SUB_BITS + 1) * STAGE_HIST_SUB + mantissa;
+}
+
+/** Middle of the range of values that fall into the bucket */
+static double
+bucket_value(size_t bucket)
+{
+	if (bucket < STAGE_HIST_SUB)
+		return bucket;
+
+	size_t exp = bucket / STAGE_HIST_SUB + STAGE_HIST_SUB_BITS - 1;
+	size_t mantissa = bucket % STAGE_HIST_SUB;
+	double width = double(uint64_t(1) << (exp - STAGE_HIST_SUB_BITS));
+	return (STAGE_HIST_SUB + mantissa) * width + width / 2;
+}
+
+namespace {
+
+/**
+ * Counters of one thread. Only the owning thread writes them, others only
+ * read them (or reset them), so relaxed loads and stores suffice.
+ */
+struct StageBlock
+{
+	std::atomic<uint64_t> counts[NUM_STAGES][STAGE_HIST_BUCKETS];
+	std::atomic<uint64_t> sums[NUM_STAGES];
+	std::atomic<uint64_t> maxes[NUM_STAGES];
+	std::atomic<uint64_t> perf_runs[NUM_STAGES];
+	std::atomic<uint64_t> perf_sums[NUM_STAGES][NUM_PERF_EVENTS];
+
+	StageBlock() { clear(); }
+
+	void clear()
+	{
+		for (auto &stage : counts)
+			for (auto &c : stage)
+				c.store(0, std::memory_order_relaxed);
+		for (auto &s : sums)
+			s.store(0, std::memory_order_relaxed);
+		for (auto &m : maxes)
+			m.store(0, std::memory_order_relaxed);
+		for (auto &r : perf_runs)
+			r.store(0, std::memory_order_relaxed);
+		for (auto &stage : perf_sums)
+			for (auto &c : stage)
+				c.store(0, std::memory_order_relaxed);
+	}
+};
+
+/**
+ * All the blocks ever used. The blocks of finished threads are reused by
+ * new ones (keeping their counts), so the memory is bounded by the
+ * number of concurrently running threads.
+ */
+struct StageRegistry
+{
+	std::mutex lock;
+	std::vector<std::unique_ptr<StageBlock>> blocks;
+	std::vector<StageBlock *> free_blocks;
+
+	static StageRegistry &get()
+	{
+		// never destroyed, threads may record until the exit
+		static StageRegistry *registry = new StageRegistry();
+		return *registry;
+	}
+};
+
+/** Holds the block of the current thread */
+struct ThreadStageBlock
+{
+	StageBlock *block;
+
+	ThreadStageBlock()
+	{
+		auto &reg = StageRegistry::get();
+		std::lock_guard lck(reg.lock);
+
+		if (!reg.free_blocks.empty()) {
+			block = reg.free_blocks.back();
+			reg.free_blocks.pop_back();
+		} else {
+			reg.blocks.emplace_back(std::make_unique<StageBlock>());
+			block = reg.blocks.back().get();
+		}
+	}
+
+	~ThreadStageBlock()
+	{
+		auto &reg = StageRegistry::get();
+		std::lock_guard lck(reg.lock);
+		reg.free_blocks.push_back(block);
+	}
+};
+
+} // namespace
+
+static StageBlock &
+thread_block()
+{
+	thread_local ThreadStageBlock tb;
+	return *tb.block;
+}
+
+static inline void
+bump(std::atomic<uint64_t> &c, uint64_t by)
+{
+	c.store(c.load(std::memory_order_relaxed) + by,
+	        std::memory_order_relaxed);
+}
+
+const char *
+StageStats::name(Stage s)
+{
+	switch (s) {
+		case Stage::KeywordEmbed:
+			return "keyword_embed";
+		case Stage::KeywordScan:
+			return "keyword_scan";
+		case Stage::Bayes:
+			return "bayes";
+		case Stage::TopN:
+			return "top_n";
+		case Stage::Knn:
+			return "knn";
+		case Stage::SomTrain:
+			return "som_train";
+		case Stage::SomMap:
+			return "som_map";
+		case Stage::NapiMarshal:
+			return "napi_marshal";
+		default:
+			return "unknown";
+	}
+}
+
+void
+StageStats::record(Stage s, uint64_t ns)
+{
+	StageBlock &b = thread_block();
+	size_t i = size_t(s);
+
+	bump(b.counts[i][bucket_of(ns)], 1);
+	bump(b.sums[i], ns);
+	if (ns > b.maxes[i].load(std::memory_order_relaxed))
+		b.maxes[i].store(ns, std::memory_order_relaxed);
+}
+
+void
+StageStats::record_counters(Stage s, const uint64_t (&deltas)[NUM_PERF_EVENTS])
+{
+	StageBlock &b = thread_block();
+	size_t i = size_t(s);
+
+	bump(b.perf_runs[i], 1);
+	for (size_t e = 0; e < NUM_PERF_EVENTS; ++e)
+		bump(b.perf_sums[i][e], deltas[e]);
+}
+
+std::string
+StageStats::to_json()
+{
+	std::vector<uint64_t> counts(STAGE_HIST_BUCKETS);
+	std::string res;
+	JsonWriter w(res);
+
+	auto &reg = StageRegistry::get();
+	std::lock_guard lck(reg.lock);
+
+	w.begin_object();
+	for (size_t s = 0; s < NUM_STAGES; ++s) {
+		std::fill(counts.begin(), counts.end(), 0);
+		uint64_t total = 0, sum = 0, max = 0, perf_runs = 0;
+		uint64_t perf_sums[NUM_PERF_EVENTS] = {};
+
+		for (auto &&b : reg.blocks) {
+			for (size_t i = 0; i < STAGE_HIST_BUCKETS; ++i) {
+				uint64_t c = b->counts[s][i].load(
+				  std::memory_order_relaxed);
+				counts[i] += c;
+				total += c;
+			}
+			sum += b->sums[s].load(std::memory_order_relaxed);
+			max = std::max(
+			  max, b->maxes[s].load(std::memory_order_relaxed));
+			perf_runs +=
+			  b->perf_runs[s].load(std::memory_order_relaxed);
+			for (size_t e = 0; e < NUM_PERF_EVENTS; ++e)
+				perf_sums[e] += b->perf_sums[s][e].load(
+				  std::memory_order_relaxed);
+		}
+
+		// the percentile is the value of the bucket it falls into
+		auto percentile = [&](double p) {
+			uint64_t rank = std::max<uint64_t>(
+			  1, uint64_t(std::ceil(p * total)));
+			uint64_t seen = 0;
+			for (size_t i = 0; i < STAGE_HIST_BUCKETS; ++i) {
+				seen += counts[i];
+				if (seen >= rank)
+					return std::min(bucket_value(i),
+					                double(max)) /
+					       1000;
+			}
+			return max / 1000.0;
+		};
+
+		w.key(name(Stage(s))).begin_object();
+		w.key("count").value(int64_t(total));
+		w.key("mean_us").value(total ? sum / 1000.0 / total : 0.0);
+		w.key("p50_us").value(total ? percentile(0.5) : 0.0);
+		w.key("p90_us").value(total ? percentile(0.9) : 0.0);
+		w.key("p99_us").value(total ? percentile(0.99) : 0.0);
+		w.key("p999_us").value(total ? percentile(0.999) : 0.0);
+		w.key("max_us").value(max / 1000.0);
+
+		if (perf_runs) {
+			w.key("counters").begin_object();
+			w.key("runs").value(int64_t(perf_runs));
+			for (size_t e = 0; e < NUM_PERF_EVENTS; ++e)
+				w.key(PerfCounters::name(PerfEvent(e)))
+				  .value(double(perf_sums[e]) / perf_runs);
+
+			uint64_t cycles = perf_sums[size_t(PerfEvent::Cycles)];
+			w.key("ipc").value(
+			  cycles ? double(perf_sums[size_t(
+			             PerfEvent::Instructions)]) /
+			             cycles
+			         : 0.0);
+			w.end_object();
+		}
+
+		w.end_object();
+	}
+	w.end_object();
+
+	return res;
+}
+
+void
+StageStats::reset()
+{
+	auto &reg = StageRegistry::get();
+	std::lock_guard lck(reg.lock);
+
+	for (auto &&b : reg.blocks)
+		b->clear();
+}
@@ -0,0 +1,156 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef stage_stats_h
+#define stage_stats_h
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "PerfCounters.h"
+#include "Trace.h"
+
+/** Instrumented stages of the request processing */
+enum class Stage
+{
+	KeywordEmbed,
+	KeywordScan,
+	Bayes,
+	TopN,
+	Knn,
+	SomTrain,
+	SomMap,
+	NapiMarshal,
+	NumItems
+};
+
+constexpr size_t NUM_STAGES = size_t(Stage::NumItems);
+
+/**
+ * Always-on latency histograms of the stages.
+ *
+ * Every thread records into its own block of counters (so the recording
+ * needs no locks nor atomic read-modify-writes), the blocks are only
+ * summed when the statistics are read. The buckets are HDR-style: exact
+ * below 2^STAGE_HIST_SUB_BITS ns, then 2^STAGE_HIST_SUB_BITS buckets per
+ * power of two, which bounds the relative error of the percentiles.
+ */
+class StageStats
+{
+public:
+	static const char *name(Stage s);
+
+	/** Records one run of the stage that took `ns` nanoseconds */
+	static void record(Stage s, uint64_t ns);
+
+	/**
+	 * Records the hardware counter deltas (see `PerfEvent`) of one run
+	 * of the stage
+	 */
+	static void record_counters(Stage s,
+	                            const uint64_t (&deltas)[NUM_PERF_EVENTS]);
+
+	/**
+	 * Returns the statistics of all stages as a JSON object of the form
+	 * `{"<stage>": {"count": .., "mean_us": .., "p50_us": .., "p90_us":
+	 * .., "p99_us": .., "p999_us": .., "max_us": ..}, ...}`.
+	 *
+	 * Stages with recorded hardware counters also get a `"counters"`
+	 * object with the number of measured runs, the per-run means of the
+	 * events and the instructions per cycle.
+	 */
+	static std::string to_json();
+
+	/** Clears the collected statistics */
+	static void reset();
+};
+
+/**
+ * Records the duration of its scope as a run of the stage (and as a trace
+ * span if the tracing is on)
+ */
+class StageTimer
+{
+	using clock = std::chrono::steady_clock;
+
+	Stage stage;
+	clock::time_point start;
+
+public:
+	explicit StageTimer(Stage s)
+	  : stage(s)
+	  , start(clock::now())
+	{}
+
+	~StageTimer()
+	{
+		auto end = clock::now();
+		StageStats::record(
+		  stage,
+		  std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+		                                                       start)
+		    .count());
+
+		if (Trace::enabled())
+			Trace::record(StageStats::name(stage), start, end);
+	}
+
+	StageTimer(const StageTimer &) = delete;
+	StageTimer &operator=(const StageTimer &) = delete;
+};
+
+/**
+ * Records the hardware counters of the current thread over its scope as
+ * a run of the stage, does nothing unless `PerfCounters` are enabled.
+ *
+ * The counters are per-thread, so multithreaded stages need one scope in
+ * every worker.
+ */
+class PerfScope
+{
+	Stage stage;
+	bool active;
+	uint64_t start[NUM_PERF_EVENTS];
+
+public:
+	explicit PerfScope(Stage s)
+	  : stage(s)
+	  , active(PerfCounters::enabled() && PerfCounters::read(start))
+	{}
+
+	~PerfScope()
+	{
+		uint64_t end[NUM_PERF_EVENTS];
+		if (!active || !PerfCounters::read(end))
+			return;
+
+		for (size_t i = 0; i < NUM_PERF_EVENTS; ++i)
+			end[i] -= start[i];
+		StageStats::record_counters(stage, end);
+	}
+
+	PerfScope(const PerfScope &) = delete;
+	PerfScope &operator=(const PerfScope &) = delete;
+};
+
+#endif
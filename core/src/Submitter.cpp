@@ -21,91 +21,167 @@
 
 #include "Submitter.h"
 
+#include "JsonWriter.h"
+
+#include <chrono>
 #include <filesystem>
 #include <fstream>
+#include <map>
 #include <memory>
 
 #include <curl/curl.h>
+#include <zlib.h>
 
+/*
+ * Writes the request into the archive file just to be sure and have it
+ * nicely archived. The file is created with the first request.
+ */
 static void
-submitter_thread(const std::string &submit_url,
-                 const std::string &query,
-                 const std::string &data,
-                 bool &finished,
-                 const SubmitterConfig &cfg)
+archive_request(std::ofstream &o,
+                const SubmitRequest &req,
+                const SubmitterConfig &cfg)
 {
-	/*
-	 * write the stuff into a file just to be sure and have it nicely
-	 * archived
-	 */
-
-	if (!std::filesystem::is_directory(cfg.VBS_submit_archive_dir))
-		std::filesystem::create_directory(cfg.VBS_submit_archive_dir);
+	if (!o.is_open()) {
+		if (!std::filesystem::is_directory(cfg.VBS_submit_archive_dir))
+			std::filesystem::create_directory(
+			  cfg.VBS_submit_archive_dir);
 
-	if (!std::filesystem::is_directory(cfg.VBS_submit_archive_dir))
-		warn("wtf, directory was not created");
+		if (!std::filesystem::is_directory(cfg.VBS_submit_archive_dir))
+			warn("wtf, directory was not created");
 
-	{
 		std::string path = cfg.VBS_submit_archive_dir +
 		                   std::string("/") +
 		                   std::to_string(timestamp()) +
 		                   cfg.VBS_submit_archive_log_suffix;
-		std::ofstream o(path.c_str(), std::ios::app);
-		if (!o) {
-			warn("Could not write a log file!");
-		} else {
-			o << "{"
-			  << "\"query_string\": \"" << query << "\","
-			  << std::endl
-			  << "\"submit_url\": \"" << submit_url << "\""
-			  << std::endl;
-
-			// Only print this if not empty
-			if (!data.empty())
-				o << ","
-				  << "\"data\":" << data << std::endl;
-
-			o << "}" << std::endl;
-		}
+		o.open(path.c_str(), std::ios::app);
 	}
 
-	if (cfg.extra_verbose_log) {
-
-		// Subtract ',' to '\n'
-		std::string data_not_so_pretty_fmtd(data);
-		std::replace(data_not_so_pretty_fmtd.begin(),
-		             data_not_so_pretty_fmtd.end(),
-		             ',',
-		             '\n');
-		std::replace(data_not_so_pretty_fmtd.begin(),
-		             data_not_so_pretty_fmtd.end(),
-		             '{',
-		             '\n');
-
-		std::cout << "**** Query string: " << query << std::endl
-		          << std::endl
-		          << "**** " << data_not_so_pretty_fmtd << std::endl;
+	if (!o) {
+		warn("Could not write a log file!");
+		return;
 	}
 
-	if (cfg.submit_to_VBS) {
-		CURL *curl = curl_easy_init();
+	o << "{"
+	  << "\"query_string\": \"" << req.query_string << "\"," << std::endl
+	  << "\"submit_url\": \"" << req.url << "\"" << std::endl;
+
+	// Only print this if not empty
+	if (!req.post_data.empty())
+		o << ","
+		  << "\"data\":" << req.post_data << std::endl;
+
+	o << "}" << std::endl;
+}
+
+static void
+print_request(const SubmitRequest &req)
+{
+	// Subtract ',' to '\n'
+	std::string data_not_so_pretty_fmtd(req.post_data);
+	std::replace(data_not_so_pretty_fmtd.begin(),
+	             data_not_so_pretty_fmtd.end(),
+	             ',',
+	             '\n');
+	std::replace(data_not_so_pretty_fmtd.begin(),
+	             data_not_so_pretty_fmtd.end(),
+	             '{',
+	             '\n');
+
+	std::cout << "**** Query string: " << req.query_string << std::endl
+	          << std::endl
+	          << "**** " << data_not_so_pretty_fmtd << std::endl;
+}
+
+/** Compresses the data into the gzip format */
+static std::string
+gzip_compress(const std::string &data)
+{
+	z_stream zs{};
+	// 15 window bits + 16 for the gzip header
+	if (deflateInit2(&zs,
+	                 Z_BEST_SPEED,
+	                 Z_DEFLATED,
+	                 15 + 16,
+	                 8,
+	                 Z_DEFAULT_STRATEGY) != Z_OK)
+		throw std::runtime_error("deflateInit2 failed");
+
+	std::string res;
+	res.resize(deflateBound(&zs, uLong(data.size())));
+
+	zs.next_in = (Bytef *)data.data();
+	zs.avail_in = uInt(data.size());
+	zs.next_out = (Bytef *)res.data();
+	zs.avail_out = uInt(res.size());
+
+	int ret = deflate(&zs, Z_FINISH);
+	res.resize(zs.total_out);
+	deflateEnd(&zs);
+
+	if (ret != Z_STREAM_END)
+		throw std::runtime_error("deflate failed");
+
+	return res;
+}
 
+/** The sender thread state: the reused curl handle and its headers */
+struct SenderConnection
+{
+	CURL *curl{ nullptr };
+	curl_slist *json_header{ nullptr };
+	curl_slist *gzip_header{ nullptr };
+
+	SenderConnection()
+	{
+		curl = curl_easy_init();
+		json_header = curl_slist_append(
+		  nullptr, "Content-type: application/json");
+		gzip_header = curl_slist_append(
+		  nullptr, "Content-type: application/json");
+		gzip_header =
+		  curl_slist_append(gzip_header, "Content-Encoding: gzip");
+
+		// The handle keeps the connection alive between the requests
 		curl_easy_setopt(curl, CURLOPT_HEADER, 0);
 		curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
 		curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30);
+		// A stalled request must not hold up the ones behind it
+		curl_easy_setopt(
+		  curl, CURLOPT_TIMEOUT, long(SUBMIT_REQUEST_TIMEOUT_S));
+		curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+		curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+		curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "POST");
+	}
+
+	~SenderConnection()
+	{
+		curl_easy_cleanup(curl);
+		curl_slist_free_all(json_header);
+		curl_slist_free_all(gzip_header);
+	}
 
+	void send(const std::string &submit_url,
+	          const std::string &query_string,
+	          const std::string &post_data,
+	          bool gzip)
+	{
 		std::string url = submit_url;
-		url += "?" + query;
+		url += "?" + query_string;
 		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-		curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "POST");
 
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
-		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, data.length());
+		std::string compressed;
+		if (gzip && !post_data.empty())
+			compressed = gzip_compress(post_data);
+		else
+			gzip = false;
 
-		// for some reason, curl refuses to work with const char ptrs
-		static std::string hdr = "Content-type: application/json";
-		static struct curl_slist reqheader = { hdr.data(), nullptr };
-		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, &reqheader);
+		const std::string &body = gzip ? compressed : post_data;
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
+		curl_easy_setopt(
+		  curl, CURLOPT_POSTFIELDSIZE, long(body.length()));
+		curl_easy_setopt(curl,
+		                 CURLOPT_HTTPHEADER,
+		                 gzip ? gzip_header : json_header);
 
 		bool curl_ok = curl_easy_perform(curl) == 0u;
 
@@ -113,24 +189,130 @@ submitter_thread(const std::string &submit_url,
 			info("Submit OK");
 		else
 			warn("Submit failed!");
-
-		curl_easy_cleanup(curl);
 	}
+};
+
+void
+Submitter::sender_thread(Submitter *parent)
+{
+	using clock = std::chrono::steady_clock;
 
-	finished = true;
+	const SubmitterConfig &cfg = parent->cfg;
+
+	std::ofstream archive;
+
+	std::unique_ptr<SenderConnection> conn;
+	if (cfg.submit_to_VBS)
+		conn = std::make_unique<SenderConnection>();
+
+	/*
+	 * Bodies of the batched log requests by the URL. A batch is sent as
+	 * one JSON array when the window ends.
+	 */
+	std::map<std::string, std::vector<std::string>> batches;
+	size_t batch_bytes = 0;
+	clock::time_point batch_deadline = clock::time_point::max();
+
+	auto send_batches = [&]() {
+		for (auto &&[url, bodies] : batches) {
+			std::string body;
+			body.reserve(batch_bytes + bodies.size() + 2);
+			body += '[';
+			for (size_t i = 0; i < bodies.size(); ++i) {
+				if (i > 0)
+					body += ',';
+				body += bodies[i];
+			}
+			body += ']';
+
+			if (conn)
+				conn->send(url, "", body, cfg.log_gzip);
+		}
+		batches.clear();
+		batch_bytes = 0;
+		batch_deadline = clock::time_point::max();
+	};
+
+	SubmitRequest req;
+	for (;;) {
+		/*
+		 * Read before popping, so that everything queued before the
+		 * flag was set is still sent.
+		 */
+		bool terminating = parent->terminate;
+
+		if (!parent->submit_queue.try_pop(req) &&
+		    !parent->send_queue.try_pop(req)) {
+			if (terminating || clock::now() >= batch_deadline)
+				send_batches();
+
+			// Terminate only once everything is sent
+			if (terminating)
+				break;
+
+			std::unique_lock lck(parent->sender_lock);
+			parent->sender_wakeup.wait_until(
+			  lck,
+			  std::min(batch_deadline,
+			           clock::now() + std::chrono::milliseconds(
+			                            SUBMIT_SENDER_WAKEUP_MS)),
+			  [parent]() {
+				  return parent->sender_pending ||
+				         parent->terminate;
+			  });
+			parent->sender_pending = false;
+			continue;
+		}
+
+		archive_request(archive, req, cfg);
+
+		if (cfg.extra_verbose_log)
+			print_request(req);
+
+		if (req.is_log && cfg.log_batch_window > 0) {
+			if (batches.empty())
+				batch_deadline =
+				  clock::now() + std::chrono::milliseconds(
+				                   cfg.log_batch_window);
+
+			batch_bytes += req.post_data.size() + 1;
+			batches[req.url].emplace_back(
+			  std::move(req.post_data));
+
+			if (batch_bytes >= LOG_BATCH_MAX_BYTES)
+				send_batches();
+			continue;
+		}
+
+		if (conn)
+			conn->send(req.url,
+			           req.query_string,
+			           req.post_data,
+			           req.is_log && cfg.log_gzip);
+	}
 }
 
 Submitter::Submitter(const SubmitterConfig &config)
-  : last_submit_timestamp(timestamp())
+  : submit_queue(SUBMIT_QUEUE_CAPACITY)
+  , send_queue(SUBMIT_QUEUE_CAPACITY)
+  , sender_pending(false)
+  , terminate(false)
+  , last_submit_timestamp(timestamp())
   , cfg(config)
-{}
+{
+	sender = std::thread(sender_thread, this);
+}
 
 Submitter::~Submitter()
 {
 	send_backlog_only();
 
-	for (auto &t : submit_threads)
-		t.join();
+	{
+		std::lock_guard lck(sender_lock);
+		terminate = true;
+	}
+	sender_wakeup.notify_all();
+	sender.join();
 }
 
 void
@@ -185,21 +367,9 @@ Submitter::submit_and_log_rescore(const DatasetFrames &frames,
                                   const size_t topn_frames_per_shot)
 {
 
-	std::vector<Json> results;
-	results.reserve(topn_imgs.size());
-
-	for (auto &&img_ID : topn_imgs) {
-		auto vf = frames.get_frame(img_ID);
-		results.push_back(Json::object{
-		  { "video", int(vf.video_ID + 1) },
-		  { "frame", int(vf.frame_number) },
-		  { "score", double(scores[img_ID]) },
-		});
-	}
-
-	std::vector<Json> used_cats;
-	std::vector<Json> used_types;
-	std::vector<Json> sort_types;
+	std::vector<std::string> used_cats;
+	std::vector<std::string> used_types;
+	std::vector<std::string> sort_types;
 
 	std::string query_val(sentence_query + ";");
 
@@ -237,20 +407,46 @@ Submitter::submit_and_log_rescore(const DatasetFrames &frames,
 	query_val += ";from_shot_limit=";
 	query_val += std::to_string(topn_frames_per_shot);
 
-	Json result_json_arr = Json::array(results);
+	auto write_array = [](JsonWriter &w,
+	                      const std::vector<std::string> &vals) {
+		w.begin_array();
+		for (auto &&v : vals)
+			w.value(v);
+		w.end_array();
+	};
+
+	// Stream the result log directly, keys are in the json11 order
+	rerank_buf.clear();
+	JsonWriter w(rerank_buf);
 
-	Json top = Json::object{ { "teamId", int(cfg.team_ID) },
-		                 { "memberId", int(cfg.member_ID) },
-		                 { "timestamp", double(timestamp()) },
-		                 { "usedCategories", used_cats },
-		                 { "usedTypes", used_types },
-		                 { "sortType", sort_types },
-		                 { "resultSetAvailability", "top" },
-		                 { "type", "result" },
-		                 { "value", query_val },
-		                 { "results", std::move(result_json_arr) } };
+	w.begin_object();
+	w.key("memberId").value(int(cfg.member_ID));
+	w.key("resultSetAvailability").value("top");
 
-	start_sender(cfg.submit_rerank_URL, "", top.dump());
+	w.key("results").begin_array();
+	for (auto &&img_ID : topn_imgs) {
+		auto &&vf = frames.get_frame(img_ID);
+		w.begin_object();
+		w.key("frame").value(int(vf.frame_number));
+		w.key("score").value(double(scores[img_ID]));
+		w.key("video").value(int(vf.video_ID + 1));
+		w.end_object();
+	}
+	w.end_array();
+
+	w.key("sortType");
+	write_array(w, sort_types);
+	w.key("teamId").value(int(cfg.team_ID));
+	w.key("timestamp").value(double(timestamp()));
+	w.key("type").value("result");
+	w.key("usedCategories");
+	write_array(w, used_cats);
+	w.key("usedTypes");
+	write_array(w, used_types);
+	w.key("value").value(query_val);
+	w.end_object();
+
+	start_sender(cfg.submit_rerank_URL, "", rerank_buf, true);
 }
 
 void
@@ -427,15 +623,21 @@ Submitter::log_reset_search()
 void
 Submitter::start_sender(const std::string &submit_url,
                         const std::string &query_string,
-                        const std::string &post_data)
+                        const std::string &post_data,
+                        bool is_log)
 {
-	finish_flags.emplace_back(std::make_unique<bool>(false));
-	submit_threads.emplace_back(submitter_thread,
-	                            submit_url,
-	                            query_string,
-	                            post_data,
-	                            std::ref(*(finish_flags.back())),
-	                            cfg);
+	auto &queue = is_log ? send_queue : submit_queue;
+	if (!queue.try_push(
+	      SubmitRequest{ submit_url, query_string, post_data, is_log })) {
+		warn("Submit queue is full, dropping the request!");
+		return;
+	}
+
+	{
+		std::lock_guard lck(sender_lock);
+		sender_pending = true;
+	}
+	sender_wakeup.notify_one();
 }
 
 void
@@ -444,14 +646,6 @@ Submitter::poll()
 	if (last_submit_timestamp + cfg.send_logs_to_server_period <
 	    size_t(timestamp()))
 		send_backlog_only();
-
-	for (size_t i = 0; i < submit_threads.size();)
-		if (*finish_flags[i]) {
-			submit_threads[i].join();
-			submit_threads.erase(submit_threads.begin() + i);
-			finish_flags.erase(finish_flags.begin() + i);
-		} else
-			++i;
 }
 
 void
@@ -463,9 +657,11 @@ Submitter::send_query_with_backlog(const std::string &query_string)
 			               { "events", std::move(backlog) },
 			               { "type", "interaction" } };
 		backlog.clear();
-		start_sender(cfg.submit_URL, query_string, a.dump());
+		// Only the backlog alone is a log, otherwise it is a submission
+		start_sender(
+		  cfg.submit_URL, query_string, a.dump(), query_string.empty());
 	} else if (!query_string.empty())
-		start_sender(cfg.submit_URL, query_string, "");
+		start_sender(cfg.submit_URL, query_string, "", false);
 
 	// We always reset timer
 	last_submit_timestamp = timestamp();
@@ -484,4 +680,9 @@ Submitter::push_event(const std::string &cat,
 		               { "value", value } };
 
 	backlog.emplace_back(std::move(a));
+
+	// Do not let the backlog grow without bounds
+	if (cfg.max_backlog_events > 0 &&
+	    backlog.size() >= cfg.max_backlog_events)
+		send_backlog_only();
 }
@@ -22,12 +22,16 @@
 #ifndef _SUBMITTER_H
 #define _SUBMITTER_H
 
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
 #include "json11.hpp"
 
+#include "BoundedQueue.h"
 #include "config_json.h"
 #include "log.h"
 #include "utils.h"
@@ -40,27 +44,50 @@ using ImageKeywords = KeywordRanker;
 
 using namespace json11;
 
+/** One HTTP request waiting for the sender thread */
+struct SubmitRequest
+{
+	std::string url;
+	std::string query_string;
+	std::string post_data;
+	/** Log requests may be batched and compressed, submissions not */
+	bool is_log;
+};
+
 class Submitter
 {
-	std::vector<std::thread> submit_threads;
-	std::vector<std::unique_ptr<bool>> finish_flags;
+	/*
+	 * All requests go through the queues to the one sender thread that
+	 * archives them into one file and sends them using one curl handle.
+	 * The submissions have their own queue that is always emptied
+	 * before the one of the logs.
+	 */
+	BoundedQueue<SubmitRequest> submit_queue;
+	BoundedQueue<SubmitRequest> send_queue;
+	std::thread sender;
+	std::condition_variable sender_wakeup;
+	std::mutex sender_lock;
+	/** Set under sender_lock when a request is queued */
+	bool sender_pending;
+	std::atomic<bool> terminate;
+
 	std::vector<Json> backlog;
 
+	/** Reused buffer for the serialized rerank result logs */
+	std::string rerank_buf;
+
 	int64_t last_submit_timestamp;
 
 	const SubmitterConfig cfg;
 
 public:
 	Submitter(const SubmitterConfig &config);
-	// waits until the last thread submits
+	// waits until the sender sends all the queued requests
 	~Submitter() noexcept;
 
-	// checks for terminated threads and logging timeout (call on each
-	// frame)
+	// checks for logging timeout (call on each frame)
 	void poll();
 
-	size_t n_submitters() { return submit_threads.size(); }
-
 	/** Called whenever we want to submit frame/shot into the server */
 	void submit_and_log_submit(const DatasetFrames &frames,
 	                           DisplayType disp_type,
@@ -115,9 +142,13 @@ public:
 	void log_reset_search();
 
 private:
+	static void sender_thread(Submitter *parent);
+
+	/** Queues the request for the sender thread */
 	void start_sender(const std::string &submit_url,
 	                  const std::string &query_string,
-	                  const std::string &post_data);
+	                  const std::string &post_data,
+	                  bool is_log);
 
 	void send_query_with_backlog(const std::string &query_string);
 
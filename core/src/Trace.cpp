@@ -0,0 +1,208 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Trace.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "JsonWriter.h"
+#include "config.h"
+
+namespace {
+
+struct TraceEvent
+{
+	const char *name;
+	Trace::clock::time_point begin;
+	Trace::clock::time_point end;
+};
+
+/**
+ * Spans of one thread. The lock is only contended when the trace is read
+ * or cleared.
+ */
+struct TraceBuffer
+{
+	std::mutex lock;
+	size_t tid;
+	std::string thread_name;
+	std::vector<TraceEvent> events;
+	size_t dropped{ 0 };
+	bool finished{ false };
+};
+
+struct TraceRegistry
+{
+	std::mutex lock;
+	std::vector<std::shared_ptr<TraceBuffer>> buffers;
+	size_t next_tid{ 1 };
+	/** Time zero of the trace */
+	Trace::clock::time_point origin{ Trace::clock::now() };
+
+	static TraceRegistry &get()
+	{
+		// never destroyed, threads may record until the exit
+		static TraceRegistry *registry = new TraceRegistry();
+		return *registry;
+	}
+};
+
+/** The buffer of the current thread, registered with its first span */
+struct ThreadTraceBuffer
+{
+	std::shared_ptr<TraceBuffer> buffer;
+	std::string name;
+
+	TraceBuffer &get()
+	{
+		if (!buffer) {
+			buffer = std::make_shared<TraceBuffer>();
+			buffer->thread_name = name;
+
+			auto &reg = TraceRegistry::get();
+			std::lock_guard lck(reg.lock);
+			buffer->tid = reg.next_tid++;
+			reg.buffers.push_back(buffer);
+		}
+		return *buffer;
+	}
+
+	~ThreadTraceBuffer()
+	{
+		if (!buffer)
+			return;
+		std::lock_guard lck(buffer->lock);
+		buffer->finished = true;
+	}
+};
+
+thread_local ThreadTraceBuffer thread_buffer;
+
+} // namespace
+
+void
+Trace::record(const char *name, clock::time_point begin, clock::time_point end)
+{
+	TraceBuffer &b = thread_buffer.get();
+	std::lock_guard lck(b.lock);
+
+	if (b.events.size() >= TRACE_MAX_EVENTS_PER_THREAD) {
+		++b.dropped;
+		return;
+	}
+	b.events.push_back(TraceEvent{ name, begin, end });
+}
+
+void
+Trace::set_thread_name(const std::string &name)
+{
+	thread_buffer.name = name;
+	if (thread_buffer.buffer) {
+		std::lock_guard lck(thread_buffer.buffer->lock);
+		thread_buffer.buffer->thread_name = name;
+	}
+}
+
+std::string
+Trace::to_json()
+{
+	auto &reg = TraceRegistry::get();
+	std::lock_guard lck(reg.lock);
+
+	auto us = [&](clock::time_point t) {
+		return std::chrono::duration<double, std::micro>(t - reg.origin)
+		  .count();
+	};
+
+	std::string res;
+	JsonWriter w(res);
+	w.begin_object();
+	w.key("displayTimeUnit").value("ms");
+	w.key("traceEvents").begin_array();
+
+	for (auto &&b : reg.buffers) {
+		std::lock_guard buf_lck(b->lock);
+		int64_t tid = int64_t(b->tid);
+
+		if (!b->thread_name.empty()) {
+			w.begin_object();
+			w.key("name").value("thread_name");
+			w.key("ph").value("M");
+			w.key("pid").value(1);
+			w.key("tid").value(tid);
+			w.key("args").begin_object();
+			w.key("name").value(b->thread_name);
+			w.end_object();
+			w.end_object();
+		}
+
+		for (auto &&e : b->events) {
+			w.begin_object();
+			w.key("name").value(e.name);
+			w.key("cat").value("core");
+			w.key("ph").value("X");
+			w.key("ts").value(us(e.begin));
+			w.key("dur").value(us(e.end) - us(e.begin));
+			w.key("pid").value(1);
+			w.key("tid").value(tid);
+			w.end_object();
+		}
+
+		if (b->dropped > 0) {
+			w.begin_object();
+			w.key("name").value("spans dropped (full buffer)");
+			w.key("ph").value("i");
+			w.key("s").value("t");
+			w.key("ts").value(
+			  b->events.empty() ? 0.0 : us(b->events.back().end));
+			w.key("pid").value(1);
+			w.key("tid").value(tid);
+			w.key("args").begin_object();
+			w.key("count").value(int64_t(b->dropped));
+			w.end_object();
+			w.end_object();
+		}
+	}
+
+	w.end_array();
+	w.end_object();
+	return res;
+}
+
+void
+Trace::clear()
+{
+	auto &reg = TraceRegistry::get();
+	std::lock_guard lck(reg.lock);
+
+	std::vector<std::shared_ptr<TraceBuffer>> alive;
+	for (auto &&b : reg.buffers) {
+		std::lock_guard buf_lck(b->lock);
+		if (b->finished)
+			continue;
+		b->events.clear();
+		b->dropped = 0;
+		alive.push_back(b);
+	}
+	reg.buffers.swap(alive);
+}
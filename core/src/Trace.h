@@ -0,0 +1,92 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef trace_h
+#define trace_h
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+/**
+ * Span recording in the Chrome trace-event format (load the output into
+ * chrome://tracing or Perfetto).
+ *
+ * Tracing is off by default and can be switched at runtime, while it is
+ * off a span costs just one relaxed atomic load. Each thread records into
+ * its own buffer of at most TRACE_MAX_EVENTS_PER_THREAD spans.
+ */
+class Trace
+{
+	static inline std::atomic<bool> on{ false };
+
+public:
+	using clock = std::chrono::steady_clock;
+
+	static bool enabled() { return on.load(std::memory_order_relaxed); }
+
+	static void enable(bool enable) { on = enable; }
+
+	/**
+	 * Records a span, `name` must be a string with the static storage
+	 * duration (e.g. a literal).
+	 */
+	static void record(const char *name,
+	                   clock::time_point begin,
+	                   clock::time_point end);
+
+	/** Names the calling thread in the trace */
+	static void set_thread_name(const std::string &name);
+
+	/** Returns the recorded spans as a Chrome trace JSON object */
+	static std::string to_json();
+
+	/** Drops the recorded spans */
+	static void clear();
+};
+
+/** Records its scope as a span (if the tracing is on at its creation) */
+class TraceSpan
+{
+	const char *name;
+	Trace::clock::time_point start{};
+	bool active;
+
+public:
+	explicit TraceSpan(const char *name)
+	  : name(name)
+	  , active(Trace::enabled())
+	{
+		if (active)
+			start = Trace::clock::now();
+	}
+
+	~TraceSpan()
+	{
+		if (active)
+			Trace::record(name, start, Trace::clock::now());
+	}
+
+	TraceSpan(const TraceSpan &) = delete;
+	TraceSpan &operator=(const TraceSpan &) = delete;
+};
+
+#endif
@@ -28,7 +28,7 @@
  * Text query settings
  */
 
-#define MAX_NUM_TEMP_QUERIES 2
+#define MAX_NUM_TEMP_QUERIES 8
 #define KW_TEMPORAL_SPAN 5 // frames
 
 /*
@@ -62,7 +62,43 @@ constexpr DisplayType POST_RESCORE_DISPLAY = DisplayType::DTopNContext;
  * Logging
  */
 
-#define LOGLEVEL 1 // 3 = debug, 2 = info, 1 = warnings, 0 = none
+/*
+ * Levels: 3 = debug, 2 = info, 1 = warnings, 0 = none
+ *
+ * LOGLEVEL is the highest level compiled in, the level actually logged
+ * starts at DEFAULT_LOGLEVEL and can be changed at runtime.
+ */
+#define LOGLEVEL 3
+#define DEFAULT_LOGLEVEL 1
+
+/** Capacity of the log message ring buffer */
+#define LOG_QUEUE_CAPACITY 4096
+/** How often the log is written out if nothing wakes the writer (in ms) */
+#define LOG_FLUSH_PERIOD_MS 200
+
+/**
+ * Precision of the stage latency histograms: each power of two is split
+ * into 2^STAGE_HIST_SUB_BITS buckets (4 bits = ~6% error)
+ */
+#define STAGE_HIST_SUB_BITS 4
+
+/** Limit of the recorded trace spans of one thread */
+#define TRACE_MAX_EVENTS_PER_THREAD (1 << 20)
+
+/** Rows of the fp32 feature matrix converted at once when loading as fp16 */
+constexpr size_t FEATURES_CONVERT_CHUNK = 4096;
+
+/**
+ * Frames re-ranked with the exact fp32 vectors after the int8/PQ first
+ * pass of the full scans (with enough spare for the per-video KNN limits)
+ */
+constexpr size_t RERANK_CANDIDATES = 2 * TOPKNN_LIMIT;
+
+/**
+ * Frames ranked with the exact distances by the KNN after the sign sketch
+ * prefilter (the sketches are coarse, so more spare than for the rerank)
+ */
+constexpr size_t SKETCH_CANDIDATES = 4 * TOPKNN_LIMIT;
 
 #define LD_LOG_DIR "./logs/"
 #define LD_LOG_FILENAME "ld"
@@ -70,6 +106,15 @@ constexpr DisplayType POST_RESCORE_DISPLAY = DisplayType::DTopNContext;
 
 #define GLOBAL_LOG_FILE "somhunter.log"
 
+/** Max. number of requests waiting for the Submitter sender thread */
+#define SUBMIT_QUEUE_CAPACITY 1024
+/** How often the idle sender thread checks the queue (in ms) */
+#define SUBMIT_SENDER_WAKEUP_MS 100
+/** Limit of one request of the sender thread, including the transfer */
+#define SUBMIT_REQUEST_TIMEOUT_S 10
+/** Batched log requests are sent early once they are this large */
+#define LOG_BATCH_MAX_BYTES (4 << 20)
+
 /** Pop-up window image grid width */
 #define DISPLAY_GRID_WIDTH 6
 
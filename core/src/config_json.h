@@ -57,6 +57,13 @@ struct SubmitterConfig
 
 	size_t send_logs_to_server_period;
 	size_t log_replay_timeout;
+
+	/** Log requests are coalesced for this long (ms), 0 = send at once */
+	size_t log_batch_window;
+	/** If the bodies of the log requests are gzip-compressed */
+	bool log_gzip;
+	/** Interaction events are sent once there are this many (0 = no cap) */
+	size_t max_backlog_events;
 };
 
 /** Parsed current config of the core.
@@ -70,11 +77,24 @@ struct Config
 	VideoFilenameOffsets filename_offsets;
 
 	std::string frames_list_file;
+	/** Optional binary catalogue replacing the frames list */
+	std::string frames_catalogue_file;
 	std::string frames_path_prefix;
 
 	size_t features_file_data_off;
 	std::string features_file;
 	size_t features_dim;
+	/**
+	 * Precision of the loaded features, "fp32" (default), "fp16", or
+	 * the quantized "int8" and "pq" (see `FeatureStorage`)
+	 */
+	std::string features_storage;
+	/** Optional pre-converted fp16 matrix (raw halves, no header) */
+	std::string features_fp16_file;
+	/** PQ codes for the "pq" storage (see `pq_codes.h`) */
+	std::string features_pq_file;
+	/** Prefilter the KNN candidates with the sign sketches of the frames */
+	bool features_sketches;
 
 	size_t pre_PCA_features_dim;
 	std::string kw_bias_vec_file;
@@ -85,10 +105,23 @@ struct Config
 
 	std::string kws_file;
 
+	/** Optional binary keyword model bundle replacing the files above */
+	std::string kw_bundle_file;
+	/** Precompute single keyword embeddings if not in the bundle */
+	bool kw_precompute_projections;
+
 	size_t display_page_size;
 	size_t topn_frames_per_video;
 	size_t topn_frames_per_shot;
 
+	/** Distance of the SOM, "eucl" (default) or "manhattan" */
+	std::string som_distance;
+
+	/** Initial runtime log level (see `Logger`) */
+	int log_level;
+	/** Also write the log into GLOBAL_LOG_FILE */
+	bool log_to_file;
+
 	static Config parse_json_config(const std::string &filepath);
 };
 
@@ -144,6 +177,12 @@ Config::parse_json_config(const std::string &filepath)
 		           .int_value()),
 		  size_t(
 		    json["submitter_config"]["log_replay_timeout"].int_value()),
+
+		  size_t(
+		    json["submitter_config"]["log_batch_window"].int_value()),
+		  json["submitter_config"]["log_gzip"].bool_value(),
+		  size_t(
+		    json["submitter_config"]["max_backlog_events"].int_value()),
 		},
 
 		size_t(json["max_frame_filename_len"].int_value()),
@@ -166,11 +205,16 @@ Config::parse_json_config(const std::string &filepath)
 		},
 
 		json["frames_list_file"].string_value(),
+		json["frames_catalogue_file"].string_value(),
 		json["frames_path_prefix"].string_value(),
 
 		size_t(json["features_file_data_off"].int_value()),
 		json["features_file"].string_value(),
 		size_t(json["features_dim"].int_value()),
+		json["features_storage"].string_value(),
+		json["features_fp16_file"].string_value(),
+		json["features_pq_file"].string_value(),
+		json["features_sketches"].bool_value(),
 
 		size_t(json["pre_PCA_features_dim"].int_value()),
 		json["kw_bias_vec_file"].string_value(),
@@ -180,10 +224,18 @@ Config::parse_json_config(const std::string &filepath)
 		size_t(json["kw_PCA_mat_dim"].int_value()),
 
 		json["kws_file"].string_value(),
+		json["kw_bundle_file"].string_value(),
+		json["kw_precompute_projections"].bool_value(),
 
 		size_t(json["display_page_size"].int_value()),
 		size_t(json["topn_frames_per_video"].int_value()),
 		size_t(json["topn_frames_per_shot"].int_value()),
+
+		json["som_distance"].string_value(),
+
+		json["log_level"].is_number() ? json["log_level"].int_value()
+		                              : DEFAULT_LOGLEVEL,
+		json["log_to_file"].bool_value(),
 	};
 
 	return cfg;
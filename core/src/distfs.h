@@ -21,6 +21,9 @@
 
 // This particular file is relicensed, originating in EmbedSOM software.
 
+#ifndef distfs_h
+#define distfs_h
+
 #include "use_intrins.h"
 #include <algorithm>
 #include <cmath>
@@ -146,3 +149,260 @@ d_dot(const float *p1, const float *p2, const size_t dim)
 	return mdist;
 #endif
 }
+
+#ifdef USE_INTRINS
+/* Cephes-style polynomial approximation of expf() on 4 lanes. */
+inline static __m128
+vec_exp(__m128 x)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	x = _mm_min_ps(x, _mm_set1_ps(88.3762626647949f));
+	x = _mm_max_ps(x, _mm_set1_ps(-88.3762626647949f));
+
+	// express exp(x) as exp(g + n*log(2))
+	__m128 fx = _mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f));
+	fx = _mm_add_ps(fx, _mm_set1_ps(0.5f));
+	__m128i emm0 = _mm_cvttps_epi32(fx);
+	__m128 tmp = _mm_cvtepi32_ps(emm0);
+	fx = _mm_sub_ps(tmp, _mm_and_ps(_mm_cmpgt_ps(tmp, fx), one));
+
+	x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(0.693359375f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(-2.12194440e-4f)));
+	__m128 z = _mm_mul_ps(x, x);
+
+	__m128 y = _mm_set1_ps(1.9875691500e-4f);
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+	y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, z), x), one);
+
+	// build 2^n
+	emm0 = _mm_cvttps_epi32(fx);
+	emm0 = _mm_add_epi32(emm0, _mm_set1_epi32(0x7f));
+	emm0 = _mm_slli_epi32(emm0, 23);
+
+	return _mm_mul_ps(y, _mm_castsi128_ps(emm0));
+}
+#endif
+
+/* Computes dst[i] *= exp(src[i] * scale) */
+inline static void
+v_mul_exp(float *dst, const float *src, const float scale, const size_t n)
+{
+#ifndef USE_INTRINS
+	for (size_t i = 0; i < n; ++i)
+		dst[i] *= expf(src[i] * scale);
+#else
+	const float *src_e = src + n, *src_ie = src_e - 3;
+
+	__m128 s = _mm_set1_ps(scale);
+	for (; src < src_ie; src += 4, dst += 4) {
+		__m128 e = vec_exp(_mm_mul_ps(_mm_loadu_ps(src), s));
+		_mm_storeu_ps(dst, _mm_mul_ps(_mm_loadu_ps(dst), e));
+	}
+	for (; src < src_e; ++src, ++dst)
+		*dst *= expf(*src * scale);
+#endif
+}
+
+#ifdef USE_INTRINS
+/* tanh(x) = 1 - 2 / (exp(2x) + 1) on 4 lanes. */
+inline static __m128
+vec_tanh(__m128 x)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	__m128 e = vec_exp(_mm_add_ps(x, x));
+	return _mm_sub_ps(one,
+	                  _mm_div_ps(_mm_set1_ps(2.0f), _mm_add_ps(e, one)));
+}
+#endif
+
+/* Computes v[i] = tanh(v[i] + bias[i]) */
+inline static void
+v_add_tanh(float *v, const float *bias, const size_t n)
+{
+#ifndef USE_INTRINS
+	for (size_t i = 0; i < n; ++i)
+		v[i] = std::tanh(v[i] + bias[i]);
+#else
+	const float *ve = v + n, *vie = ve - 3;
+
+	for (; v < vie; v += 4, bias += 4) {
+		__m128 x = _mm_add_ps(_mm_loadu_ps(v), _mm_loadu_ps(bias));
+		_mm_storeu_ps(v, vec_tanh(x));
+	}
+	for (; v < ve; ++v, ++bias)
+		*v = std::tanh(*v + *bias);
+#endif
+}
+
+/* Computes dst[i] += src[i] */
+inline static void
+v_add(float *dst, const float *src, const size_t n)
+{
+#ifndef USE_INTRINS
+	for (size_t i = 0; i < n; ++i)
+		dst[i] += src[i];
+#else
+	const float *dst_e = dst + n, *dst_ie = dst_e - 3;
+
+	for (; dst < dst_ie; dst += 4, src += 4)
+		_mm_storeu_ps(dst,
+		              _mm_add_ps(_mm_loadu_ps(dst), _mm_loadu_ps(src)));
+	for (; dst < dst_e; ++dst, ++src)
+		*dst += *src;
+#endif
+}
+
+/*
+ * Variants of the distance kernels for a dimension known at compile time (a
+ * multiple of 16), the loops have a constant trip count and no tail, so they
+ * get unrolled, and they use 4 independent accumulators.
+ */
+
+#ifdef USE_INTRINS
+/* Sums op(block of p1, block of p2) over the 4-float blocks */
+template<size_t Dim, typename Op>
+inline static float
+sum_blocks(const float *p1, const float *p2, Op op)
+{
+	static_assert(Dim % 16 == 0, "fixed dimensions are multiples of 16");
+
+	__m128 s0 = _mm_setzero_ps(), s1 = s0, s2 = s0, s3 = s0;
+	for (size_t i = 0; i < Dim; i += 16) {
+		s0 = _mm_add_ps(
+		  s0, op(_mm_loadu_ps(p1 + i), _mm_loadu_ps(p2 + i)));
+		s1 = _mm_add_ps(
+		  s1, op(_mm_loadu_ps(p1 + i + 4), _mm_loadu_ps(p2 + i + 4)));
+		s2 = _mm_add_ps(
+		  s2, op(_mm_loadu_ps(p1 + i + 8), _mm_loadu_ps(p2 + i + 8)));
+		s3 = _mm_add_ps(
+		  s3,
+		  op(_mm_loadu_ps(p1 + i + 12), _mm_loadu_ps(p2 + i + 12)));
+	}
+	__m128 s = _mm_add_ps(_mm_add_ps(s0, s1), _mm_add_ps(s2, s3));
+	return get<0>(s) + get<1>(s) + get<2>(s) + get<3>(s);
+}
+#endif
+
+template<size_t Dim>
+inline static float
+d_sqeucl(const float *p1, const float *p2)
+{
+#ifndef USE_INTRINS
+	return d_sqeucl(p1, p2, Dim);
+#else
+	return sum_blocks<Dim>(p1, p2, [](__m128 a, __m128 b) {
+		__m128 tmp = _mm_sub_ps(a, b);
+		return _mm_mul_ps(tmp, tmp);
+	});
+#endif
+}
+
+template<size_t Dim>
+inline static float
+d_manhattan(const float *p1, const float *p2)
+{
+#ifndef USE_INTRINS
+	return d_manhattan(p1, p2, Dim);
+#else
+	return sum_blocks<Dim>(p1, p2, [](__m128 a, __m128 b) {
+		return vec_abs(_mm_sub_ps(a, b));
+	});
+#endif
+}
+
+template<size_t Dim>
+inline static float
+d_dot(const float *p1, const float *p2)
+{
+#ifndef USE_INTRINS
+	return d_dot(p1, p2, Dim);
+#else
+	return sum_blocks<Dim>(
+	  p1, p2, [](__m128 a, __m128 b) { return _mm_mul_ps(a, b); });
+#endif
+}
+
+/* The kernels that can be chosen at runtime (see `with_dist_kernel`) */
+enum class DistKernel
+{
+	SqEucl,
+	Manhattan,
+	Dot
+};
+
+/*
+ * The kernel as a callable `(p1, p2, dim)`, the fixed-dimension variant
+ * (that ignores `dim`) unless Dim is 0.
+ */
+template<DistKernel K, size_t Dim>
+struct dist_kernel
+{
+	inline float operator()(const float *p1,
+	                        const float *p2,
+	                        [[maybe_unused]] size_t dim) const
+	{
+		if constexpr (Dim == 0) {
+			if constexpr (K == DistKernel::SqEucl)
+				return d_sqeucl(p1, p2, dim);
+			else if constexpr (K == DistKernel::Manhattan)
+				return d_manhattan(p1, p2, dim);
+			else
+				return d_dot(p1, p2, dim);
+		} else {
+			if constexpr (K == DistKernel::SqEucl)
+				return d_sqeucl<Dim>(p1, p2);
+			else if constexpr (K == DistKernel::Manhattan)
+				return d_manhattan<Dim>(p1, p2);
+			else
+				return d_dot<Dim>(p1, p2);
+		}
+	}
+};
+
+/*
+ * Calls `f` with the kernel (see `dist_kernel`) for vectors of `dim` floats,
+ * specialized for the dimension of the PCA features (128) and of the
+ * keyword model (2048). The dimension is only checked once, the kernel is
+ * then inlined in the loops of `f`.
+ */
+template<DistKernel K, typename F>
+inline static void
+with_dist_kernel(size_t dim, F &&f)
+{
+	switch (dim) {
+		case 128:
+			f(dist_kernel<K, 128>{});
+			break;
+		case 2048:
+			f(dist_kernel<K, 2048>{});
+			break;
+		default:
+			f(dist_kernel<K, 0>{});
+	}
+}
+
+/* The same with the kernel chosen at runtime */
+template<typename F>
+inline static void
+with_dist_kernel(DistKernel kernel, size_t dim, F &&f)
+{
+	switch (kernel) {
+		case DistKernel::SqEucl:
+			with_dist_kernel<DistKernel::SqEucl>(dim, f);
+			break;
+		case DistKernel::Manhattan:
+			with_dist_kernel<DistKernel::Manhattan>(dim, f);
+			break;
+		case DistKernel::Dot:
+			with_dist_kernel<DistKernel::Dot>(dim, f);
+			break;
+	}
+}
+
+#endif // distfs_h
@@ -0,0 +1,234 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef distfs16_h
+#define distfs16_h
+
+/*
+ * Kernels over half-precision (IEEE fp16) vectors. The halves are widened
+ * to floats on the fly, with F16C if the CPU has it (8 lanes per load),
+ * the accumulation is always in fp32.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "use_intrins.h"
+
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define USE_F16C
+#include <immintrin.h>
+#endif
+
+inline static float
+half_to_float(uint16_t h)
+{
+#ifdef USE_F16C
+	return _cvtsh_ss(h);
+#else
+	uint32_t sign = uint32_t(h & 0x8000) << 16;
+	uint32_t exp = (h >> 10) & 0x1f, mant = h & 0x3ff;
+	uint32_t x;
+
+	if (exp == 0x1f) // inf, nan
+		x = sign | 0x7f800000 | (mant << 13);
+	else if (exp == 0) { // zero, subnormals
+		float f = mant * (1.0f / 16777216.0f);
+		std::memcpy(&x, &f, sizeof(x));
+		x |= sign;
+	} else
+		x = sign | ((exp + 112) << 23) | (mant << 13);
+
+	float f;
+	std::memcpy(&f, &x, sizeof(f));
+	return f;
+#endif
+}
+
+/* Rounds to the nearest half (ties to even), saturates to infinity */
+inline static uint16_t
+float_to_half(float f)
+{
+#ifdef USE_F16C
+	return _cvtss_sh(f, 0);
+#else
+	uint32_t x;
+	std::memcpy(&x, &f, sizeof(x));
+	uint16_t sign = (x >> 16) & 0x8000;
+	x &= 0x7fffffff;
+
+	if (x >= 0x7f800000) // inf, nan
+		return sign | 0x7c00 | (x > 0x7f800000 ? 0x200 : 0);
+	if (x >= 0x477ff000) // rounds to more than the largest half
+		return sign | 0x7c00;
+	if (x < 0x38800000) {
+		// subnormal halves: let the FPU round at the 2^-24 unit
+		float a;
+		std::memcpy(&a, &x, sizeof(a));
+		a += 0.5f;
+		std::memcpy(&x, &a, sizeof(x));
+		return sign | uint16_t(x - 0x3f000000);
+	}
+
+	// rebias the exponent and round the mantissa to 10 bits
+	x += 0xc8000fff + ((x >> 13) & 1);
+	return sign | uint16_t(x >> 13);
+#endif
+}
+
+/* Loads of one or eight values as floats */
+
+inline static float
+load1(const float *p)
+{
+	return *p;
+}
+
+inline static float
+load1(const uint16_t *p)
+{
+	return half_to_float(*p);
+}
+
+#ifdef USE_F16C
+inline static __m256
+load8(const float *p)
+{
+	return _mm256_loadu_ps(p);
+}
+
+inline static __m256
+load8(const uint16_t *p)
+{
+	return _mm256_cvtph_ps(
+	  _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+}
+
+inline static float
+hsum8(__m256 v)
+{
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(v),
+	                      _mm256_extractf128_ps(v, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+	return _mm_cvtss_f32(s);
+}
+#endif
+
+inline static void
+half_to_float(const uint16_t *src, float *dst, size_t n)
+{
+	size_t i = 0;
+#ifdef USE_F16C
+	for (; i + 8 <= n; i += 8)
+		_mm256_storeu_ps(dst + i, load8(src + i));
+#endif
+	for (; i < n; ++i)
+		dst[i] = half_to_float(src[i]);
+}
+
+inline static void
+float_to_half(const float *src, uint16_t *dst, size_t n)
+{
+	size_t i = 0;
+#ifdef USE_F16C
+	for (; i + 8 <= n; i += 8)
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+		                 _mm256_cvtps_ph(_mm256_loadu_ps(src + i), 0));
+#endif
+	for (; i < n; ++i)
+		dst[i] = float_to_half(src[i]);
+}
+
+/*
+ * The kernels take the first operand either as floats (queries, SOM
+ * neurons) or as halves (other frames), the second one is always halves.
+ */
+
+template<typename T>
+inline static float
+d_dot16(const T *p1, const uint16_t *p2, const size_t dim)
+{
+	size_t i = 0;
+	float res = 0;
+#ifdef USE_F16C
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+	for (; i + 16 <= dim; i += 16) {
+		s0 = _mm256_add_ps(
+		  s0, _mm256_mul_ps(load8(p1 + i), load8(p2 + i)));
+		s1 = _mm256_add_ps(
+		  s1, _mm256_mul_ps(load8(p1 + i + 8), load8(p2 + i + 8)));
+	}
+	for (; i + 8 <= dim; i += 8)
+		s0 = _mm256_add_ps(
+		  s0, _mm256_mul_ps(load8(p1 + i), load8(p2 + i)));
+	res = hsum8(_mm256_add_ps(s0, s1));
+#endif
+	for (; i < dim; ++i)
+		res += load1(p1 + i) * load1(p2 + i);
+	return res;
+}
+
+template<typename T>
+inline static float
+d_sqeucl16(const T *p1, const uint16_t *p2, const size_t dim)
+{
+	size_t i = 0;
+	float res = 0;
+#ifdef USE_F16C
+	__m256 s = _mm256_setzero_ps();
+	for (; i + 8 <= dim; i += 8) {
+		__m256 tmp = _mm256_sub_ps(load8(p1 + i), load8(p2 + i));
+		s = _mm256_add_ps(s, _mm256_mul_ps(tmp, tmp));
+	}
+	res = hsum8(s);
+#endif
+	for (; i < dim; ++i) {
+		float tmp = load1(p1 + i) - load1(p2 + i);
+		res += tmp * tmp;
+	}
+	return res;
+}
+
+template<typename T>
+inline static float
+d_manhattan16(const T *p1, const uint16_t *p2, const size_t dim)
+{
+	size_t i = 0;
+	float res = 0;
+#ifdef USE_F16C
+	const __m256 abs_mask =
+	  _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 s = _mm256_setzero_ps();
+	for (; i + 8 <= dim; i += 8)
+		s = _mm256_add_ps(
+		  s,
+		  _mm256_and_ps(abs_mask,
+		                _mm256_sub_ps(load8(p1 + i), load8(p2 + i))));
+	res = hsum8(s);
+#endif
+	for (; i < dim; ++i)
+		res += std::abs(load1(p1 + i) - load1(p2 + i));
+	return res;
+}
+
+#endif // distfs16_h
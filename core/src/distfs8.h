@@ -0,0 +1,154 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef distfs8_h
+#define distfs8_h
+
+/*
+ * Kernels over int8 scalar-quantized vectors (see the int8 storage of
+ * DatasetFeatures), the products are accumulated exactly in int32.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+/* Integer dot product of two int8 vectors */
+inline static int32_t
+d_dot8(const int8_t *p1, const int8_t *p2, const size_t dim)
+{
+	size_t i = 0;
+	int32_t res = 0;
+#if defined(__AVX2__)
+	__m256i s = _mm256_setzero_si256();
+	for (; i + 16 <= dim; i += 16) {
+		__m256i a = _mm256_cvtepi8_epi16(
+		  _mm_loadu_si128(reinterpret_cast<const __m128i *>(p1 + i)));
+		__m256i b = _mm256_cvtepi8_epi16(
+		  _mm_loadu_si128(reinterpret_cast<const __m128i *>(p2 + i)));
+		s = _mm256_add_epi32(s, _mm256_madd_epi16(a, b));
+	}
+	__m128i t = _mm_add_epi32(_mm256_castsi256_si128(s),
+	                          _mm256_extracti128_si256(s, 1));
+	t = _mm_add_epi32(t, _mm_shuffle_epi32(t, _MM_SHUFFLE(1, 0, 3, 2)));
+	t = _mm_add_epi32(t, _mm_shuffle_epi32(t, _MM_SHUFFLE(2, 3, 0, 1)));
+	res = _mm_cvtsi128_si32(t);
+#elif defined(__SSE4_1__)
+	__m128i s = _mm_setzero_si128();
+	for (; i + 8 <= dim; i += 8) {
+		__m128i a = _mm_cvtepi8_epi16(
+		  _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p1 + i)));
+		__m128i b = _mm_cvtepi8_epi16(
+		  _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p2 + i)));
+		s = _mm_add_epi32(s, _mm_madd_epi16(a, b));
+	}
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+	res = _mm_cvtsi128_si32(s);
+#endif
+	for (; i < dim; ++i)
+		res += int32_t(p1[i]) * int32_t(p2[i]);
+	return res;
+}
+
+/*
+ * Quantizes the query for the dot products with vectors quantized with
+ * the per-dimension `scales` (x[d] ~ scales[d] * x8[d]): the query is
+ * multiplied by the scales and quantized with one common scale, which
+ * is returned, so that dot(q, x) ~ returned * d_dot8(q8, x8).
+ */
+inline static float
+quantize_query8(const float *q,
+                const float *scales,
+                int8_t *q8,
+                const size_t dim)
+{
+	float max = 0;
+	for (size_t d = 0; d < dim; ++d)
+		max = std::max(max, std::abs(q[d] * scales[d]));
+	if (max == 0) {
+		std::fill(q8, q8 + dim, 0);
+		return 0;
+	}
+
+	float scale = max / 127;
+	for (size_t d = 0; d < dim; ++d)
+		q8[d] = int8_t(std::lround(q[d] * scales[d] / scale));
+	return scale;
+}
+
+/*
+ * Dot product of a float vector and a vector quantized with the
+ * per-dimension `scales`, i.e. the sum of q[d] * scales[d] * x8[d].
+ */
+inline static float
+d_dot8f(const float *q, const int8_t *x8, const float *scales, const size_t dim)
+{
+	size_t i = 0;
+	float res = 0;
+#if defined(__AVX2__)
+	__m256 s = _mm256_setzero_ps();
+	for (; i + 8 <= dim; i += 8) {
+		__m256 x = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(
+		  _mm_loadl_epi64(reinterpret_cast<const __m128i *>(x8 + i))));
+		__m256 qs = _mm256_mul_ps(_mm256_loadu_ps(q + i),
+		                          _mm256_loadu_ps(scales + i));
+		s = _mm256_add_ps(s, _mm256_mul_ps(qs, x));
+	}
+	__m128 t = _mm_add_ps(_mm256_castps256_ps128(s),
+	                      _mm256_extractf128_ps(s, 1));
+	t = _mm_add_ps(t, _mm_movehl_ps(t, t));
+	t = _mm_add_ss(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1)));
+	res = _mm_cvtss_f32(t);
+#elif defined(__SSE4_1__)
+	__m128 s = _mm_setzero_ps();
+	for (; i + 4 <= dim; i += 4) {
+		int32_t w;
+		std::memcpy(&w, x8 + i, sizeof(w));
+		__m128 x =
+		  _mm_cvtepi32_ps(_mm_cvtepi8_epi32(_mm_cvtsi32_si128(w)));
+		__m128 qs =
+		  _mm_mul_ps(_mm_loadu_ps(q + i), _mm_loadu_ps(scales + i));
+		s = _mm_add_ps(s, _mm_mul_ps(qs, x));
+	}
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1)));
+	res = _mm_cvtss_f32(s);
+#endif
+	for (; i < dim; ++i)
+		res += q[i] * scales[i] * float(x8[i]);
+	return res;
+}
+
+/* Widens the quantized vector back to floats */
+inline static void
+dequantize8(const int8_t *x8, const float *scales, float *out, size_t dim)
+{
+	for (size_t d = 0; d < dim; ++d)
+		out[d] = scales[d] * float(x8[d]);
+}
+
+#endif // distfs8_h
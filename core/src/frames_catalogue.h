@@ -0,0 +1,67 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef frames_catalogue_h
+#define frames_catalogue_h
+
+#include <cstdint>
+
+/*
+ * Binary frame catalogue
+ *
+ * Preparsed `frames_list_file` that is memory mapped on startup instead of
+ * parsing the text list. Layout (all offsets are in bytes from the file
+ * beginning, all sections are aligned to FRAMES_CATALOGUE_ALIGN):
+ *
+ *    FramesCatalogueHeader
+ *    uint32_t[num_frames]      (video IDs)
+ *    uint32_t[num_frames]      (shot IDs)
+ *    uint32_t[num_frames]      (frame numbers)
+ *    uint64_t[num_frames + 1]  (filename offsets into the filename data)
+ *    char[]                    (filename data, no terminators)
+ *
+ * Frames are stored in the frame ID order.
+ *
+ * Bump FRAMES_CATALOGUE_VERSION whenever the layout changes.
+ */
+
+#define FRAMES_CATALOGUE_MAGIC "SHFRMCTL"
+#define FRAMES_CATALOGUE_VERSION 1
+#define FRAMES_CATALOGUE_ALIGN 64
+
+struct FramesCatalogueHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+
+	uint64_t num_frames;
+
+	uint64_t video_IDs_off;
+	uint64_t shot_IDs_off;
+	uint64_t frame_nums_off;
+	uint64_t filename_offs_off;
+	uint64_t filenames_off;
+
+	uint64_t file_size;
+};
+
+#endif // frames_catalogue_h
@@ -0,0 +1,92 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef kw_bundle_h
+#define kw_bundle_h
+
+#include <cstdint>
+
+/*
+ * Binary keyword model bundle
+ *
+ * Everything the KeywordRanker needs in one file that is memory mapped on
+ * startup. Layout (all offsets are in bytes from the file beginning,
+ * all sections are aligned to KW_BUNDLE_ALIGN):
+ *
+ *    KwBundleHeader
+ *    KwBundleKeyword[num_keywords]   (sorted by kw_ID)
+ *    uint64_t[num_strings + 1]       (string offsets into the string data)
+ *    char[]                          (string data, no terminators)
+ *    float[num_weight_rows][pre_PCA_dim] (keyword weights by kw_ID)
+ *    float[pre_PCA_dim]              (keyword bias)
+ *    float[PCA_dim][pre_PCA_dim]     (PCA matrix)
+ *    float[pre_PCA_dim]              (PCA mean)
+ *    float[num_weight_rows][PCA_dim] (projected single keyword
+ *                                     embeddings, since version 2)
+ *
+ * Bump KW_BUNDLE_VERSION whenever the layout changes.
+ */
+
+#define KW_BUNDLE_MAGIC "SHKWBNDL"
+#define KW_BUNDLE_VERSION 3
+#define KW_BUNDLE_ALIGN 64
+
+struct KwBundleHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+
+	uint64_t num_keywords;
+	uint64_t num_strings;
+	uint64_t pre_PCA_dim;
+	uint64_t PCA_dim;
+
+	uint64_t keywords_off;
+	uint64_t str_offsets_off;
+	uint64_t str_data_off;
+	uint64_t weights_off;
+	uint64_t bias_off;
+	uint64_t PCA_mat_off;
+	uint64_t PCA_mean_off;
+
+	uint64_t file_size;
+
+	/** Zero if the projected embeddings are missing */
+	uint64_t projected_off;
+
+	/**
+	 * All rows of the source weight matrix, every kw_ID must be below
+	 * it (since version 3)
+	 */
+	uint64_t num_weight_rows;
+};
+
+struct KwBundleKeyword
+{
+	uint64_t kw_ID;
+	uint64_t synset_ID;
+	/** Index of the first synset string in the string table */
+	uint64_t first_str;
+	uint64_t num_strs;
+};
+
+#endif // kw_bundle_h
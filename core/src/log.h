@@ -24,37 +24,198 @@
 
 #include "config.h"
 
+#include "BoundedQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 
-#if LOGLEVEL > 0
+/**
+ * Asynchronous logger behind the log macros.
+ *
+ * The messages are pushed into a lock-free ring buffer and a background
+ * thread writes them to `std::cerr` (and optionally to `GLOBAL_LOG_FILE`),
+ * flushing only when the buffer is drained. Messages that do not fit into
+ * a full buffer are dropped and counted. The level can be changed at
+ * runtime up to the `LOGLEVEL` compiled in.
+ *
+ * Warnings are written and flushed synchronously (after the queued
+ * messages), as they often precede a throw or a crash that would not
+ * leave the background thread the time to write them.
+ */
+class Logger
+{
+	BoundedQueue<std::string> queue;
+	std::atomic<int> level;
+	std::atomic<size_t> dropped;
+	/** Set at exit, messages are then written directly */
+	std::atomic<bool> synchronous;
+
+	// guards the outputs
+	std::mutex out_lock;
+	std::ofstream file;
+
+	std::mutex wakeup_lock;
+	std::condition_variable wakeup;
+
+	Logger()
+	  : queue(LOG_QUEUE_CAPACITY)
+	  , level(DEFAULT_LOGLEVEL)
+	  , dropped(0)
+	  , synchronous(false)
+	{
+		std::thread(&Logger::flusher, this).detach();
+		std::atexit([]() { get().flush_at_exit(); });
+	}
+
+public:
+	/** The logger is never destroyed, so it may log until the exit */
+	static Logger &get()
+	{
+		static Logger *logger = new Logger();
+		return *logger;
+	}
+
+	/** Formatting buffer of the calling thread, cleared */
+	static std::ostringstream &stream()
+	{
+		thread_local std::ostringstream ss;
+		ss.str(std::string());
+		return ss;
+	}
+
+	bool enabled(int lvl) const
+	{
+		return lvl <= level.load(std::memory_order_relaxed);
+	}
+
+	/** 3 = debug, 2 = info, 1 = warnings, 0 = none */
+	void set_level(int lvl) { level = lvl; }
+	int get_level() const { return level; }
+
+	/** Also write the log into `GLOBAL_LOG_FILE` */
+	void set_file_output(bool enable)
+	{
+		std::lock_guard lck(out_lock);
+		if (enable && !file.is_open())
+			file.open(GLOBAL_LOG_FILE, std::ios::app);
+		else if (!enable && file.is_open())
+			file.close();
+	}
+
+	void write(int lvl, std::string &&msg)
+	{
+		if (synchronous || lvl <= 1) {
+			std::lock_guard lck(out_lock);
+			drain();
+			output(msg);
+			flush_outputs();
+			return;
+		}
+
+		if (!queue.try_push(std::move(msg)))
+			++dropped;
+		else
+			wakeup.notify_one();
+	}
+
+	/** Writes out all the queued messages */
+	void flush()
+	{
+		std::lock_guard lck(out_lock);
+		drain();
+	}
+
+private:
+	void output(const std::string &msg)
+	{
+		std::cerr << msg;
+		if (file.is_open())
+			file << msg;
+	}
+
+	void flush_outputs()
+	{
+		std::cerr.flush();
+		if (file.is_open())
+			file.flush();
+	}
+
+	/** Call with out_lock held */
+	void drain()
+	{
+		std::string msg;
+		bool any = false;
+		while (queue.try_pop(msg)) {
+			output(msg);
+			any = true;
+		}
+
+		if (size_t n = dropped.exchange(0); n > 0) {
+			output("* " + std::to_string(n) +
+			       " log messages dropped (full log buffer)\n");
+			any = true;
+		}
+
+		if (any)
+			flush_outputs();
+	}
+
+	void flusher()
+	{
+		for (;;) {
+			flush();
+
+			std::unique_lock lck(wakeup_lock);
+			wakeup.wait_for(
+			  lck, std::chrono::milliseconds(LOG_FLUSH_PERIOD_MS));
+		}
+	}
+
+	void flush_at_exit()
+	{
+		synchronous = true;
+		flush();
+	}
+};
 
 #define _dont_write_log                                                        \
 	do {                                                                   \
 	} while (0)
-#define _write_log(level, x)                                                   \
+
+#if LOGLEVEL > 0
+
+#define _write_log(lvl, prefix, x)                                             \
 	do {                                                                   \
-		std::cerr << level << x << "\n\t(" << __func__                 \
-		          << " in " __FILE__ " :" << __LINE__ << ")"           \
-		          << std::endl;                                        \
+		if (Logger::get().enabled(lvl)) {                              \
+			std::ostringstream &_log_ss = Logger::stream();        \
+			_log_ss << prefix << x << "\n\t(" << __func__          \
+			        << " in " __FILE__ " :" << __LINE__ << ")\n";  \
+			Logger::get().write(lvl, _log_ss.str());               \
+		}                                                              \
 	} while (0)
 
-#define warn(x) _write_log("* ", x)
+#define warn(x) _write_log(1, "* ", x)
 #else
-#define warn(x)
-#define _write_log(level, x)
+#define warn(x) _dont_write_log
+#define _write_log(lvl, prefix, x) _dont_write_log
 #endif
 
 #if LOGLEVEL > 1
-#define info(x) _write_log("- ", x)
+#define info(x) _write_log(2, "- ", x)
 #else
 #define info(x) _dont_write_log
 #endif
 
 #if LOGLEVEL > 2
-#define debug(x) _write_log(". ", x)
+#define debug(x) _write_log(3, ". ", x)
 #else
 #define debug(x) _dont_write_log
 #endif
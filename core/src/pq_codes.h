@@ -0,0 +1,68 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef pq_codes_h
+#define pq_codes_h
+
+#include <cstdint>
+
+/*
+ * Product-quantized feature codes
+ *
+ * The feature vectors are split into `num_subspaces` subvectors of
+ * `dim / num_subspaces` dimensions, each subvector is encoded as the
+ * index of the nearest of PQ_NUM_CENTROIDS centroids of its subspace.
+ * Written by `features_converter pq` and memory mapped on startup with
+ * the "pq" features storage. Layout (all offsets are in bytes from the
+ * file beginning, all sections are aligned to PQ_CODES_ALIGN):
+ *
+ *    PqCodesHeader
+ *    float[num_subspaces][PQ_NUM_CENTROIDS][dim / num_subspaces]
+ *                              (codebooks)
+ *    uint8_t[num_frames][num_subspaces]  (codes)
+ *
+ * Frames are stored in the frame ID order.
+ *
+ * Bump PQ_CODES_VERSION whenever the layout changes.
+ */
+
+#define PQ_CODES_MAGIC "SHPQCODE"
+#define PQ_CODES_VERSION 1
+#define PQ_CODES_ALIGN 64
+#define PQ_NUM_CENTROIDS 256
+
+struct PqCodesHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+
+	uint64_t num_frames;
+	uint32_t dim;
+	uint32_t num_subspaces;
+
+	uint64_t codebooks_off;
+	uint64_t codes_off;
+
+	uint64_t file_size;
+};
+
+#endif // pq_codes_h
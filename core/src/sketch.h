@@ -0,0 +1,75 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef sketch_h
+#define sketch_h
+
+/*
+ * Binary sign sketches of the feature vectors (one bit per dimension, set
+ * if the component is positive) compared by the Hamming distance.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/* Number of 64-bit words of the sketch of a `dim`-dimensional vector */
+inline static size_t
+sketch_words(size_t dim)
+{
+	return (dim + 63) / 64;
+}
+
+/* Writes the sketch of the vector into `out` (of `sketch_words(dim)`) */
+inline static void
+sign_sketch(const float *v, size_t dim, uint64_t *out)
+{
+	for (size_t w = 0; w < sketch_words(dim); ++w)
+		out[w] = 0;
+	for (size_t d = 0; d < dim; ++d)
+		if (v[d] > 0)
+			out[d / 64] |= uint64_t(1) << (d % 64);
+}
+
+inline static unsigned
+popcount64(uint64_t x)
+{
+#if defined(_MSC_VER)
+	return unsigned(__popcnt64(x));
+#else
+	return unsigned(__builtin_popcountll(x));
+#endif
+}
+
+/* Hamming distance of two sketches of `words` words */
+inline static unsigned
+d_hamming(const uint64_t *p1, const uint64_t *p2, size_t words)
+{
+	unsigned res = 0;
+	for (size_t w = 0; w < words; ++w)
+		res += popcount64(p1[w] ^ p2[w]);
+	return res;
+}
+
+#endif // sketch_h
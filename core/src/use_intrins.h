@@ -32,6 +32,7 @@
 #if defined(_MSC_VER)
 #include <wmmintrin.h>
 #else
+#include <emmintrin.h>
 #include <xmmintrin.h>
 #endif
 #endif
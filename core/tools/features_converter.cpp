@@ -0,0 +1,106 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Converts the feature matrix referenced by the JSON config
+ * (`features_file`) into another storage format.
+ *
+ * Usage: features_converter [options] <format> <config.json> <output file>
+ *
+ * Formats:
+ *   fp16   raw IEEE halves, set the output as `features_fp16_file` and
+ *          `features_storage` to "fp16" in the config
+ *   pq     product-quantized codes (see `pq_codes.h`), set the output as
+ *          `features_pq_file` and `features_storage` to "pq"
+ *
+ * Options of the PQ training:
+ *   --subspaces <m>    subspaces, i.e. bytes per frame (16), must divide
+ *                      the feature dimension
+ *   --iters <count>    k-means iterations (25)
+ *   --sample <points>  size of the training sample (65536)
+ */
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "DatasetFeatures.h"
+#include "config_json.h"
+
+int
+main(int argc, char **argv)
+{
+	size_t subspaces = 16, iters = 25, sample = 65536;
+	std::vector<std::string> args;
+
+	try {
+		for (int i = 1; i < argc; ++i) {
+			std::string arg = argv[i];
+			auto next = [&]() -> size_t {
+				if (i + 1 >= argc)
+					throw std::runtime_error(
+					  "Missing value of " + arg);
+				return std::stoul(argv[++i]);
+			};
+
+			if (arg == "--subspaces")
+				subspaces = next();
+			else if (arg == "--iters")
+				iters = next();
+			else if (arg == "--sample")
+				sample = next();
+			else if (arg.rfind("--", 0) == 0)
+				throw std::runtime_error("Unknown option " +
+				                         arg);
+			else
+				args.push_back(arg);
+		}
+
+		if (args.size() != 3)
+			throw std::runtime_error("Wrong number of arguments");
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << "\nUsage: " << argv[0]
+		          << " [--subspaces m] [--iters count] "
+		             "[--sample points] fp16|pq <config.json> "
+		             "<output file>"
+		          << std::endl;
+		return 1;
+	}
+
+	try {
+		const std::string &format = args[0];
+		auto config = Config::parse_json_config(args[1]);
+
+		if (format == "fp16")
+			DatasetFeatures::write_fp16_features(config, args[2]);
+		else if (format == "pq")
+			DatasetFeatures::write_pq_features(
+			  config, args[2], subspaces, iters, sample);
+		else
+			throw std::runtime_error("Unknown format " + format);
+	} catch (const std::exception &e) {
+		std::cerr << "Conversion failed: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
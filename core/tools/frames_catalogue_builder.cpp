@@ -0,0 +1,54 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Converts the text frames list referenced by the JSON config
+ * (`frames_list_file` parsed with `filename_offsets`) into a binary
+ * catalogue that can be set as `frames_catalogue_file` in the config.
+ *
+ * Usage: frames_catalogue_builder <config.json> <output catalogue>
+ */
+
+#include <iostream>
+#include <stdexcept>
+
+#include "DatasetFrames.h"
+#include "config_json.h"
+
+int
+main(int argc, char **argv)
+{
+	if (argc != 3) {
+		std::cerr << "Usage: " << argv[0]
+		          << " <config.json> <output catalogue>" << std::endl;
+		return 1;
+	}
+
+	try {
+		auto config = Config::parse_json_config(argv[1]);
+		DatasetFrames::write_frames_catalogue(config, argv[2]);
+	} catch (const std::exception &e) {
+		std::cerr << "Conversion failed: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,55 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Converts the keyword model files referenced by the JSON config
+ * (`kws_file`, `kw_scores_mat_file`, `kw_bias_vec_file`, `kw_PCA_mat_file`
+ * and `kw_PCA_mean_vec_file`) into a single binary bundle that can be set
+ * as `kw_bundle_file` in the config.
+ *
+ * Usage: kw_bundle_converter <config.json> <output bundle>
+ */
+
+#include <iostream>
+#include <stdexcept>
+
+#include "KeywordRanker.h"
+#include "config_json.h"
+
+int
+main(int argc, char **argv)
+{
+	if (argc != 3) {
+		std::cerr << "Usage: " << argv[0]
+		          << " <config.json> <output bundle>" << std::endl;
+		return 1;
+	}
+
+	try {
+		auto config = Config::parse_json_config(argv[1]);
+		KeywordRanker::write_kw_bundle(config, argv[2]);
+	} catch (const std::exception &e) {
+		std::cerr << "Conversion failed: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,447 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmarks of the computation-heavy parts of the core.
+ *
+ * The distance kernels and the SOM run on random unit-norm points of the
+ * size given on the command line. If a JSON config is given, the scoring,
+ * KNN and keyword ranking are benchmarked on the dataset it references
+ * (use a synthetic dataset to get other sizes).
+ *
+ * Usage: somhunter_bench [options] [config.json]
+ *
+ *   --n <points>       number of points for the kernels (100000)
+ *   --dim <dim>        dimension of the points (128)
+ *   --reps <count>     timed repetitions of each benchmark (10)
+ *   --som-iters <its>  SOM iterations (SOM_ITERS)
+ *   --seed <seed>      seed of the random data (0)
+ *   --query <query>    keyword query (first keywords of the vocabulary)
+ *   --filter <substr>  run only the benchmarks with matching names
+ *
+ * Each benchmark is run once to warm up, then the times of the repetitions
+ * are reported.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Dataset.h"
+#include "RelevanceScores.h"
+#include "SOM.h"
+#include "config_json.h"
+
+struct BenchOptions
+{
+	size_t n{ 100000 };
+	size_t dim{ 128 };
+	size_t reps{ 10 };
+	size_t som_iters{ SOM_ITERS };
+	unsigned seed{ 0 };
+	std::string query;
+	std::string filter;
+	std::string config_file;
+};
+
+/** Keeps the benchmarked results alive */
+static volatile float sink;
+
+static std::vector<float>
+random_points(size_t n, size_t dim, std::mt19937 &rng)
+{
+	std::normal_distribution<float> dist;
+	std::vector<float> points(n * dim);
+
+	for (size_t i = 0; i < n; ++i) {
+		float *p = points.data() + i * dim;
+		float norm = 0;
+		for (size_t d = 0; d < dim; ++d) {
+			p[d] = dist(rng);
+			norm += p[d] * p[d];
+		}
+		norm = 1 / sqrtf(norm);
+		for (size_t d = 0; d < dim; ++d)
+			p[d] *= norm;
+	}
+
+	return points;
+}
+
+/**
+ * Runs `body` once to warm up and `opts.reps` times timed, `setup` is
+ * called (untimed) before each run. `items` is the number of items one run
+ * processes (for the throughput).
+ */
+static void
+bench(const BenchOptions &opts,
+      const std::string &name,
+      size_t items,
+      const std::function<void()> &setup,
+      const std::function<void()> &body)
+{
+	if (name.find(opts.filter) == std::string::npos)
+		return;
+
+	using clk = std::chrono::steady_clock;
+	std::vector<double> times;
+
+	for (size_t rep = 0; rep <= opts.reps; ++rep) {
+		setup();
+		auto start = clk::now();
+		body();
+		std::chrono::duration<double, std::milli> t =
+		  clk::now() - start;
+		if (rep > 0)
+			times.push_back(t.count());
+	}
+
+	if (times.empty())
+		return;
+
+	std::sort(times.begin(), times.end());
+	double sum = 0;
+	for (double t : times)
+		sum += t;
+	double mean = sum / times.size();
+	double median = times[times.size() / 2];
+
+	std::printf("%-28s %6zu %12.3f %12.3f %12.3f %14.0f\n",
+	            name.c_str(),
+	            times.size(),
+	            times.front(),
+	            median,
+	            mean,
+	            items / (median / 1000));
+	std::fflush(stdout);
+}
+
+static void
+bench_kernels(const BenchOptions &opts)
+{
+	std::mt19937 rng(opts.seed);
+	size_t n = opts.n, dim = opts.dim;
+	auto points = random_points(n, dim, rng);
+	auto query = random_points(1, dim, rng);
+
+	auto nop = []() {};
+
+	bench(opts, "d_dot", n, nop, [&]() {
+		float acc = 0;
+		for (size_t i = 0; i < n; ++i)
+			acc +=
+			  d_dot(query.data(), points.data() + i * dim, dim);
+		sink = acc;
+	});
+
+	bench(opts, "d_sqeucl", n, nop, [&]() {
+		float acc = 0;
+		for (size_t i = 0; i < n; ++i)
+			acc +=
+			  d_sqeucl(query.data(), points.data() + i * dim, dim);
+		sink = acc;
+	});
+
+	// the kernels specialized for the dimension (if it is a common one)
+	bench(opts, "d_dot_fixed", n, nop, [&]() {
+		with_dist_kernel<DistKernel::Dot>(dim, [&](auto dot) {
+			float acc = 0;
+			for (size_t i = 0; i < n; ++i)
+				acc += dot(
+				  query.data(), points.data() + i * dim, dim);
+			sink = acc;
+		});
+	});
+
+	bench(opts, "d_sqeucl_fixed", n, nop, [&]() {
+		with_dist_kernel<DistKernel::SqEucl>(dim, [&](auto dist) {
+			float acc = 0;
+			for (size_t i = 0; i < n; ++i)
+				acc += dist(
+				  query.data(), points.data() + i * dim, dim);
+			sink = acc;
+		});
+	});
+
+	// the same points stored as halves
+	std::vector<uint16_t> points16(n * dim);
+	float_to_half(points.data(), points16.data(), n * dim);
+
+	bench(opts, "d_dot_fp16", n, nop, [&]() {
+		float acc = 0;
+		for (size_t i = 0; i < n; ++i)
+			acc += d_dot16(
+			  query.data(), points16.data() + i * dim, dim);
+		sink = acc;
+	});
+
+	bench(opts, "d_sqeucl_fp16", n, nop, [&]() {
+		float acc = 0;
+		for (size_t i = 0; i < n; ++i)
+			acc += d_sqeucl16(
+			  query.data(), points16.data() + i * dim, dim);
+		sink = acc;
+	});
+
+	// the same setup as in AsyncSom
+	const size_t gw = SOM_DISPLAY_GRID_WIDTH, gh = SOM_DISPLAY_GRID_HEIGHT;
+	const size_t k = gw * gh;
+	std::vector<float> nhbrdist(k * k);
+	for (size_t x1 = 0; x1 < gw; ++x1)
+		for (size_t y1 = 0; y1 < gh; ++y1)
+			for (size_t x2 = 0; x2 < gw; ++x2)
+				for (size_t y2 = 0; y2 < gh; ++y2) {
+					size_t i = x1 + gw * (y1 + gh * x2) +
+					           gw * gh * gw * y2;
+					nhbrdist[i] =
+					  std::abs(float(x1) - float(x2)) +
+					  std::abs(float(y1) - float(y2));
+				}
+
+	float alphasA[2] = { 0.3f, 0.1f };
+	float alphasB[2] = { -0.01f * alphasA[0], -0.01f * alphasA[1] };
+	float radiiA[2] = { float(gw + gh) / 3, 0.1f };
+	float radiiB[2] = { 1.1f * radiiA[0], 1.1f * radiiA[1] };
+
+	std::vector<float> scores(n);
+	std::uniform_real_distribution<float> score_dist(0.01f, 1.0f);
+	for (auto &s : scores)
+		s = score_dist(rng);
+
+	// the mapping below also runs with the SOM filtered out
+	std::vector<float> koho(k * dim, 0);
+	std::mt19937 som_rng;
+	bench(
+	  opts,
+	  "som",
+	  opts.som_iters,
+	  [&]() {
+		  koho.assign(k * dim, 0);
+		  som_rng.seed(opts.seed);
+	  },
+	  [&]() {
+		  som(n,
+		      k,
+		      dim,
+		      DistKernel::SqEucl,
+		      opts.som_iters,
+		      points.data(),
+		      koho,
+		      nhbrdist,
+		      alphasA,
+		      radiiA,
+		      alphasB,
+		      radiiB,
+		      scores,
+		      som_rng);
+	  });
+
+	std::vector<size_t> mapping(n);
+	bench(opts, "mapPointsToKohos", n, nop, [&]() {
+		mapPointsToKohos(n,
+		                 k,
+		                 dim,
+		                 DistKernel::SqEucl,
+		                 points.data(),
+		                 koho,
+		                 mapping);
+		sink = mapping[n / 2];
+	});
+
+	bench(opts, "mapPointsToKohos_manhattan", n, nop, [&]() {
+		mapPointsToKohos(n,
+		                 k,
+		                 dim,
+		                 DistKernel::Manhattan,
+		                 points.data(),
+		                 koho,
+		                 mapping);
+		sink = mapping[n / 2];
+	});
+
+	bench(opts, "mapPointsToKohos_fp16", n, nop, [&]() {
+		mapPointsToKohos(n,
+		                 k,
+		                 dim,
+		                 DistKernel::SqEucl,
+		                 points16.data(),
+		                 koho,
+		                 mapping);
+		sink = mapping[n / 2];
+	});
+}
+
+static void
+bench_dataset(const BenchOptions &opts)
+{
+	auto config = Config::parse_json_config(opts.config_file);
+	Dataset ds(config);
+	const auto &frames = ds.frames;
+	size_t n = frames.size();
+
+	std::cout << "dataset: " << n << " frames, " << ds.features.dim()
+	          << " dimensions, "
+	          << DatasetFeatures::storage_name(ds.features.get_storage())
+	          << " features" << std::endl;
+
+	if (n == 0)
+		return;
+
+	std::mt19937 rng(opts.seed);
+	std::uniform_int_distribution<ImageId> frame_dist(0, n - 1);
+	std::uniform_real_distribution<float> score_dist(0.01f, 1.0f);
+
+	ScoreModel scores(frames);
+	std::vector<float> random_scores(n);
+	for (auto &s : random_scores)
+		s = score_dist(rng);
+	auto randomize_scores = [&]() {
+		for (ImageId i = 0; i < n; ++i)
+			scores.set(i, random_scores[i]);
+	};
+
+	bench(opts, "ScoreModel::top_n", n, randomize_scores, [&]() {
+		auto res = scores.top_n(frames,
+		                        config.display_page_size,
+		                        config.topn_frames_per_video,
+		                        config.topn_frames_per_shot);
+		sink = res.empty() ? 0 : res.front();
+	});
+
+	// a screen of random frames with a few of them liked
+	std::set<ImageId> screen, likes;
+	while (screen.size() < std::min<size_t>(n, config.display_page_size))
+		screen.insert(frame_dist(rng));
+	for (auto it = screen.begin(); it != screen.end() && likes.size() < 3;
+	     ++it)
+		likes.insert(*it);
+
+	bench(opts, "ScoreModel::apply_bayes", n, randomize_scores, [&]() {
+		scores.apply_bayes(likes, screen, ds.features);
+		sink = scores[0];
+	});
+
+	ImageId knn_query = frame_dist(rng);
+	bench(
+	  opts, "get_top_knn", n, []() {}, [&]() {
+		  auto res =
+		    ds.features.get_top_knn(frames,
+		                            knn_query,
+		                            config.topn_frames_per_video,
+		                            config.topn_frames_per_shot);
+		  sink = res.empty() ? 0 : res.front();
+	  });
+
+	std::string query = opts.query;
+	if (query.empty())
+		query = ds.keywords[0].synset_strs.front() + " " +
+		        ds.keywords[1].synset_strs.front() + " > " +
+		        ds.keywords[2].synset_strs.front();
+
+	bench(
+	  opts,
+	  "rank_sentence_query",
+	  n,
+	  [&]() { scores.reset(); },
+	  [&]() {
+		  ds.keywords.rank_sentence_query(
+		    query, scores, ds.features, frames, config);
+		  sink = scores[0];
+	  });
+}
+
+int
+main(int argc, char **argv)
+{
+	BenchOptions opts;
+
+	try {
+		for (int i = 1; i < argc; ++i) {
+			std::string arg = argv[i];
+			auto next = [&]() -> std::string {
+				if (i + 1 >= argc)
+					throw std::runtime_error(
+					  "Missing value of " + arg);
+				return argv[++i];
+			};
+
+			if (arg == "--n")
+				opts.n = std::stoul(next());
+			else if (arg == "--dim")
+				opts.dim = std::stoul(next());
+			else if (arg == "--reps")
+				opts.reps = std::stoul(next());
+			else if (arg == "--som-iters")
+				opts.som_iters = std::stoul(next());
+			else if (arg == "--seed")
+				opts.seed = std::stoul(next());
+			else if (arg == "--query")
+				opts.query = next();
+			else if (arg == "--filter")
+				opts.filter = next();
+			else if (arg.rfind("--", 0) == 0)
+				throw std::runtime_error("Unknown option " +
+				                         arg);
+			else
+				opts.config_file = arg;
+		}
+
+		if (opts.n == 0 || opts.dim == 0)
+			throw std::runtime_error("Empty benchmark data");
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << "\nUsage: " << argv[0]
+		          << " [--n points] [--dim dim] [--reps count] "
+		             "[--som-iters its] [--seed seed] [--query query] "
+		             "[--filter substr] [config.json]"
+		          << std::endl;
+		return 1;
+	}
+
+	std::printf("%-28s %6s %12s %12s %12s %14s\n",
+	            "benchmark",
+	            "reps",
+	            "min [ms]",
+	            "median [ms]",
+	            "mean [ms]",
+	            "items/s");
+
+	try {
+		std::cout << "kernels: " << opts.n << " points, " << opts.dim
+		          << " dimensions" << std::endl;
+		bench_kernels(opts);
+
+		if (!opts.config_file.empty())
+			bench_dataset(opts);
+	} catch (const std::exception &e) {
+		std::cerr << "Benchmark failed: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
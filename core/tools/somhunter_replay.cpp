@@ -0,0 +1,528 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Replays the interaction archives written by `Submitter` (the files in
+ * `VBS_submit_archive_dir`) against a `SomHunter` instance and reports
+ * the latency percentiles of each kind of call.
+ *
+ * The archives are turned back into calls as follows:
+ *   - rerank result logs -> `rescore` with the logged text query
+ *   - like/dislike events -> `add_likes`/`remove_likes`
+ *   - display events -> `get_display` of the same type (first page)
+ *   - reset events -> `reset_search_session`
+ *   - submissions -> `submit_to_server`
+ * and ordered by their timestamps. Each archive file is replayed in its
+ * own search session over the same dataset. Submitting to the server is
+ * disabled and the replay archives its own logs into a separate
+ * directory.
+ *
+ * Usage: somhunter_replay [options] <config.json> <archive file/dir>...
+ *
+ *   --out-archive <dir>  where the replay archives its logs
+ *                        (somhunter-replay-log in the temp directory)
+ *   --som-timeout <ms>   how long to wait for the SOM before a SOM display
+ *                        (10000)
+ *   --trace <file>       write a Chrome trace of the replay into the file
+ *   --perf               count the hardware events of the scan kernels and
+ *                        print them with the stage statistics
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "PerfCounters.h"
+#include "SomHunter.h"
+#include "StageStats.h"
+#include "Trace.h"
+#include "config_json.h"
+#include "json11.hpp"
+
+using json11::Json;
+
+enum class CallType
+{
+	Rescore,
+	AddLike,
+	RemoveLike,
+	Display,
+	Reset,
+	Submit
+};
+
+struct ReplayCall
+{
+	ReplayCall(double timestamp, CallType type)
+	  : timestamp(timestamp)
+	  , type(type)
+	{}
+
+	double timestamp;
+	CallType type;
+
+	std::string query;
+	ImageId frame_ID{ IMAGE_ID_ERR_VAL };
+	DisplayType display{ DisplayType::DNull };
+};
+
+struct ReplayOptions
+{
+	std::string out_archive_dir;
+	size_t som_timeout{ 10000 };
+	std::string trace_file;
+	bool perf{ false };
+	std::string config_file;
+	std::vector<std::string> archives;
+};
+
+/** Latencies of the replayed calls (in ms) by the call name */
+using Latencies = std::map<std::string, std::vector<double>>;
+
+static std::string
+display_name(DisplayType d)
+{
+	switch (d) {
+		case DisplayType::DTopKNN:
+			return "topknn";
+		case DisplayType::DSom:
+			return "som";
+		case DisplayType::DTopN:
+			return "topn";
+		case DisplayType::DTopNContext:
+			return "topn_context";
+		case DisplayType::DRand:
+			return "random";
+		case DisplayType::DVideoDetail:
+			return "video_detail";
+		default:
+			return "other";
+	}
+}
+
+static std::string
+call_name(const ReplayCall &c)
+{
+	switch (c.type) {
+		case CallType::Rescore:
+			return "rescore";
+		case CallType::AddLike:
+			return "add_likes";
+		case CallType::RemoveLike:
+			return "remove_likes";
+		case CallType::Display:
+			return "get_display(" + display_name(c.display) + ")";
+		case CallType::Reset:
+			return "reset_search_session";
+		case CallType::Submit:
+			return "submit_to_server";
+	}
+	return "unknown";
+}
+
+/** Parses the frame ID from the event values like `...;FId123;like;` */
+static ImageId
+parse_frame_ID(const std::string &value)
+{
+	auto pos = value.find("FId");
+	if (pos == std::string::npos)
+		return IMAGE_ID_ERR_VAL;
+
+	char *end;
+	ImageId id = std::strtoul(value.c_str() + pos + 3, &end, 10);
+	return *end == ';' ? id : IMAGE_ID_ERR_VAL;
+}
+
+/** Parses a number parameter from the submission query string */
+static long
+parse_query_param(const std::string &query, const std::string &name)
+{
+	auto pos = query.find(name + "=");
+	if (pos == std::string::npos)
+		return -1;
+
+	return std::strtol(query.c_str() + pos + name.size() + 1, nullptr, 10);
+}
+
+/** Translates one logged event into a call, returns false if not a call */
+static bool
+event_to_call(const Json &ev, ReplayCall &call)
+{
+	const std::string &cat = ev["category"].string_value();
+	const std::string &type = ev["type"].string_value();
+	const std::string &value = ev["value"].string_value();
+
+	call.timestamp = ev["timestamp"].number_value();
+
+	if (cat == "image" && type == "feedbackModel") {
+		if (value.find(";like;") != std::string::npos)
+			call.type = CallType::AddLike;
+		else if (value.find(";dislike;") != std::string::npos)
+			call.type = CallType::RemoveLike;
+		else
+			return false;
+		call.frame_ID = parse_frame_ID(value);
+		return true;
+	}
+
+	call.type = CallType::Display;
+	if (cat == "image" && type == "globalFeatures") {
+		call.display = DisplayType::DTopKNN;
+		call.frame_ID = parse_frame_ID(value);
+	} else if (cat == "browsing" && type == "videoSummary" &&
+	           value.find(";video_detail;") != std::string::npos) {
+		call.display = DisplayType::DVideoDetail;
+		call.frame_ID = parse_frame_ID(value);
+	} else if (cat == "browsing" && type == "randomSelection")
+		call.display = DisplayType::DRand;
+	else if (cat == "browsing" && type == "exploration")
+		call.display = DisplayType::DSom;
+	else if (cat == "browsing" && type == "rankedList" &&
+	         value.rfind("topn_display", 0) == 0)
+		call.display = DisplayType::DTopN;
+	else if (cat == "browsing" && type == "rankedList" &&
+	         value.rfind("topn_context_display", 0) == 0)
+		call.display = DisplayType::DTopNContext;
+	else if (cat == "browsing" && type == "resetAll")
+		call.type = CallType::Reset;
+	else
+		return false; // scrolling, replays and text (part of rescore)
+
+	return true;
+}
+
+/** Returns the frame with the given (VBS) video ID and frame number */
+static ImageId
+find_frame(const DatasetFrames &frames, long video, long frame_num)
+{
+	if (video < 1 || size_t(video) > frames.get_num_videos())
+		return IMAGE_ID_ERR_VAL;
+
+	for (auto &&f : frames.get_all_video_frames(VideoId(video - 1)))
+		if (long(f.frame_number) == frame_num)
+			return f.frame_ID;
+
+	return IMAGE_ID_ERR_VAL;
+}
+
+/** Reads the calls from one archive file, ordered by time */
+static std::vector<ReplayCall>
+parse_archive(const std::string &path, const DatasetFrames &frames)
+{
+	std::ifstream ifs(path);
+	if (!ifs)
+		throw std::runtime_error("Error opening file: " + path);
+	std::string contents((std::istreambuf_iterator<char>(ifs)),
+	                     std::istreambuf_iterator<char>());
+
+	std::string err;
+	std::string::size_type stop_pos;
+	auto records = Json::parse_multi(contents, stop_pos, err);
+	if (!err.empty()) {
+		// a record that failed to parse is kept as a null value; the
+		// failure may also come after the last complete record
+		if (!records.empty() && records.back().is_null())
+			records.pop_back();
+		warn("Archive " << path << " is damaged at " << stop_pos
+		                << ", replaying the first " << records.size()
+		                << " records");
+	}
+
+	std::vector<ReplayCall> calls;
+	double last_timestamp = 0;
+	size_t unknown_frames = 0;
+
+	for (auto &&rec : records) {
+		const Json &data = rec["data"];
+		if (data["timestamp"].is_number())
+			last_timestamp = data["timestamp"].number_value();
+
+		const std::string &type = data["type"].string_value();
+		if (type == "result") {
+			// the value is "<query>;<rescore type>;<limits>"
+			const std::string &value = data["value"].string_value();
+			auto end = value.rfind(";normal_rescore;");
+			if (end == std::string::npos)
+				end = value.rfind(";show_knn;");
+
+			ReplayCall call{ last_timestamp, CallType::Rescore };
+			call.query = value.substr(0, end);
+			calls.emplace_back(std::move(call));
+		} else if (type == "interaction") {
+			for (auto &&ev : data["events"].array_items()) {
+				ReplayCall call{ 0, CallType::Display };
+				if (event_to_call(ev, call))
+					calls.emplace_back(std::move(call));
+			}
+		}
+
+		// submissions also carry the backlog, if any
+		const std::string &query = rec["query_string"].string_value();
+		if (!query.empty()) {
+			long video = parse_query_param(query, "video");
+			long frame_num = parse_query_param(query, "frame");
+
+			ReplayCall call{ last_timestamp, CallType::Submit };
+			call.frame_ID = find_frame(frames, video, frame_num);
+			calls.emplace_back(std::move(call));
+		}
+	}
+
+	// drop the calls with frames that are not in this dataset
+	auto needs_frame = [](const ReplayCall &c) {
+		return c.type == CallType::AddLike ||
+		       c.type == CallType::RemoveLike ||
+		       c.type == CallType::Submit ||
+		       c.display == DisplayType::DTopKNN ||
+		       c.display == DisplayType::DVideoDetail;
+	};
+	calls.erase(std::remove_if(calls.begin(),
+	                           calls.end(),
+	                           [&](const ReplayCall &c) {
+		                           if (!needs_frame(c) ||
+		                               c.frame_ID < frames.size())
+			                           return false;
+		                           ++unknown_frames;
+		                           return true;
+	                           }),
+	            calls.end());
+	if (unknown_frames > 0)
+		warn(unknown_frames << " calls in " << path
+		                    << " refer to unknown frames, skipped");
+
+	std::stable_sort(calls.begin(),
+	                 calls.end(),
+	                 [](const ReplayCall &a, const ReplayCall &b) {
+		                 return a.timestamp < b.timestamp;
+	                 });
+	return calls;
+}
+
+static void
+replay(SomHunter &sh,
+       const std::vector<ReplayCall> &calls,
+       const ReplayOptions &opts,
+       Latencies &lat)
+{
+	using clk = std::chrono::steady_clock;
+	using ms = std::chrono::duration<double, std::milli>;
+
+	for (auto &&c : calls) {
+		// the UI waits for the SOM before showing it, so do we
+		if (c.type == CallType::Display &&
+		    c.display == DisplayType::DSom) {
+			auto start = clk::now();
+			auto deadline =
+			  start + std::chrono::milliseconds(opts.som_timeout);
+			while (!sh.som_ready() && clk::now() < deadline)
+				std::this_thread::sleep_for(
+				  std::chrono::milliseconds(1));
+			lat["som_wait"].push_back(
+			  ms(clk::now() - start).count());
+		}
+
+		auto start = clk::now();
+		switch (c.type) {
+			case CallType::Rescore:
+				sh.rescore(c.query);
+				break;
+			case CallType::AddLike:
+				sh.add_likes({ c.frame_ID });
+				break;
+			case CallType::RemoveLike:
+				sh.remove_likes({ c.frame_ID });
+				break;
+			case CallType::Display:
+				sh.get_display(c.display, c.frame_ID, 0);
+				break;
+			case CallType::Reset:
+				sh.reset_search_session();
+				break;
+			case CallType::Submit:
+				sh.submit_to_server(c.frame_ID);
+				break;
+		}
+		lat[call_name(c)].push_back(ms(clk::now() - start).count());
+	}
+}
+
+static void
+print_latencies(Latencies &lat)
+{
+	std::printf("%-28s %8s %10s %10s %10s %10s %10s\n",
+	            "call",
+	            "count",
+	            "p50 [ms]",
+	            "p90 [ms]",
+	            "p99 [ms]",
+	            "max [ms]",
+	            "mean [ms]");
+
+	for (auto &&[name, times] : lat) {
+		std::sort(times.begin(), times.end());
+		auto pct = [&](double p) {
+			size_t rank = size_t(p * times.size() + 0.999999);
+			return times[std::clamp<size_t>(rank, 1, times.size()) -
+			             1];
+		};
+		double sum = 0;
+		for (double t : times)
+			sum += t;
+
+		std::printf("%-28s %8zu %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+		            name.c_str(),
+		            times.size(),
+		            pct(0.5),
+		            pct(0.9),
+		            pct(0.99),
+		            times.back(),
+		            sum / times.size());
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	namespace fs = std::filesystem;
+	ReplayOptions opts;
+
+	try {
+		for (int i = 1; i < argc; ++i) {
+			std::string arg = argv[i];
+			auto next = [&]() -> std::string {
+				if (i + 1 >= argc)
+					throw std::runtime_error(
+					  "Missing value of " + arg);
+				return argv[++i];
+			};
+
+			if (arg == "--out-archive")
+				opts.out_archive_dir = next();
+			else if (arg == "--som-timeout")
+				opts.som_timeout = std::stoul(next());
+			else if (arg == "--trace")
+				opts.trace_file = next();
+			else if (arg == "--perf")
+				opts.perf = true;
+			else if (arg.rfind("--", 0) == 0)
+				throw std::runtime_error("Unknown option " +
+				                         arg);
+			else if (opts.config_file.empty())
+				opts.config_file = arg;
+			else
+				opts.archives.push_back(arg);
+		}
+
+		if (opts.archives.empty())
+			throw std::runtime_error("Nothing to replay");
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << "\nUsage: " << argv[0]
+		          << " [--out-archive dir] [--som-timeout ms] "
+		             "[--trace file] [--perf] <config.json> "
+		             "<archive file/dir>..."
+		          << std::endl;
+		return 1;
+	}
+
+	try {
+		// expand the directories, the files are named by time
+		std::vector<std::string> files;
+		for (auto &&a : opts.archives) {
+			if (!fs::is_directory(a)) {
+				files.push_back(a);
+				continue;
+			}
+			std::vector<std::string> dir_files;
+			for (auto &&e : fs::directory_iterator(a))
+				if (e.is_regular_file())
+					dir_files.push_back(e.path().string());
+			std::sort(dir_files.begin(), dir_files.end());
+			files.insert(
+			  files.end(), dir_files.begin(), dir_files.end());
+		}
+
+		auto config = Config::parse_json_config(opts.config_file);
+		config.submitter_config.submit_to_VBS = false;
+		config.submitter_config.VBS_submit_archive_dir =
+		  opts.out_archive_dir.empty()
+		    ? (fs::temp_directory_path() / "somhunter-replay-log")
+		        .string()
+		    : opts.out_archive_dir;
+
+		auto dataset = std::make_shared<const Dataset>(config);
+
+		if (!opts.trace_file.empty()) {
+			Trace::set_thread_name("replay");
+			Trace::enable(true);
+		}
+
+		if (opts.perf && !PerfCounters::enable(true))
+			std::cerr << "Hardware counters are not available"
+			          << std::endl;
+
+		Latencies lat;
+		size_t n_calls = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (auto &&f : files) {
+			auto calls = parse_archive(f, dataset->frames);
+			std::cout << "Replaying " << calls.size()
+			          << " calls from " << f << std::endl;
+
+			SomHunter sh(dataset);
+			replay(sh, calls, opts, lat);
+			n_calls += calls.size();
+		}
+		std::chrono::duration<double> total =
+		  std::chrono::steady_clock::now() - start;
+
+		std::cout << "Replayed " << n_calls << " calls from "
+		          << files.size() << " archives in " << total.count()
+		          << " s" << std::endl;
+		print_latencies(lat);
+
+		if (opts.perf)
+			std::cout << "Stage statistics: "
+			          << StageStats::to_json() << std::endl;
+
+		if (!opts.trace_file.empty()) {
+			Trace::enable(false);
+			std::ofstream out(opts.trace_file);
+			out << Trace::to_json();
+			if (!out)
+				throw std::runtime_error(
+				  "Error writing the trace");
+		}
+	} catch (const std::exception &e) {
+		std::cerr << "Replay failed: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
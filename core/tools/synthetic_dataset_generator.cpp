@@ -0,0 +1,494 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Generates a synthetic dataset of the given size for load and scaling
+ * tests, together with a JSON config that uses it.
+ *
+ * The frame features are clustered unit-norm vectors: each video picks a
+ * random cluster, its shots are scattered around the cluster center and
+ * the frames around their shot. The keyword model is built so that each
+ * keyword query points to one of the clusters.
+ *
+ * Usage: synthetic_dataset_generator [options] <output directory>
+ *
+ *   --frames <count>          number of frames (1000000)
+ *   --dim <dim>               dimension of the frame features (128)
+ *   --pre-pca-dim <dim>       dimension of the keyword model (2048)
+ *   --keywords <count>        size of the keyword vocabulary (10000)
+ *   --clusters <count>        number of feature clusters (1000)
+ *   --shots-per-video <avg>   average number of shots in a video (40)
+ *   --frames-per-shot <avg>   average number of frames in a shot (5)
+ *   --seed <seed>             random seed (0)
+ *
+ * The output directory then contains `config.json` which can be passed
+ * to the core, e.g. to `somhunter_bench`.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct GeneratorOptions
+{
+	size_t frames{ 1000000 };
+	size_t dim{ 128 };
+	size_t pre_pca_dim{ 2048 };
+	size_t keywords{ 10000 };
+	size_t clusters{ 1000 };
+	size_t shots_per_video{ 40 };
+	size_t frames_per_shot{ 5 };
+	unsigned seed{ 0 };
+	std::string out_dir;
+};
+
+/** Limits given by the filename offsets in the written config */
+constexpr size_t MAX_VIDEOS = 100000;
+constexpr size_t MAX_SHOTS_PER_VIDEO = 100000;
+
+/** Spread of the shots around the cluster and of frames around the shot */
+constexpr float SHOT_SPREAD = 0.5f;
+constexpr float FRAME_SPREAD = 0.15f;
+constexpr float KEYWORD_SPREAD = 0.2f;
+
+/** Scale of the keyword vectors (small enough for tanh to be ~linear) */
+constexpr float KEYWORD_SCALE = 0.5f;
+
+static void
+normalize(float *v, size_t dim)
+{
+	float len = 0;
+	for (size_t d = 0; d < dim; ++d)
+		len += v[d] * v[d];
+	len = 1 / std::sqrt(len);
+	for (size_t d = 0; d < dim; ++d)
+		v[d] *= len;
+}
+
+/** Writes `dst = normalize(center + spread * N(0, 1/dim))` */
+static void
+scatter(const float *center,
+        float spread,
+        size_t dim,
+        float *dst,
+        std::mt19937 &rng)
+{
+	std::normal_distribution<float> noise(0, spread / std::sqrt(dim));
+	for (size_t d = 0; d < dim; ++d)
+		dst[d] = center[d] + noise(rng);
+	normalize(dst, dim);
+}
+
+static std::vector<float>
+random_unit_vectors(size_t n, size_t dim, std::mt19937 &rng)
+{
+	std::normal_distribution<float> dist;
+	std::vector<float> res(n * dim);
+	for (size_t i = 0; i < n; ++i) {
+		for (size_t d = 0; d < dim; ++d)
+			res[i * dim + d] = dist(rng);
+		normalize(res.data() + i * dim, dim);
+	}
+	return res;
+}
+
+/** Random `rows x cols` matrix with orthonormal rows (rows <= cols) */
+static std::vector<float>
+random_orthonormal_rows(size_t rows, size_t cols, std::mt19937 &rng)
+{
+	std::normal_distribution<double> dist;
+	std::vector<double> m(rows * cols);
+	for (auto &x : m)
+		x = dist(rng);
+
+	// Gram-Schmidt
+	for (size_t i = 0; i < rows; ++i) {
+		double *r = m.data() + i * cols;
+		for (size_t j = 0; j < i; ++j) {
+			const double *q = m.data() + j * cols;
+			double dot = 0;
+			for (size_t d = 0; d < cols; ++d)
+				dot += r[d] * q[d];
+			for (size_t d = 0; d < cols; ++d)
+				r[d] -= dot * q[d];
+		}
+		double len = 0;
+		for (size_t d = 0; d < cols; ++d)
+			len += r[d] * r[d];
+		len = 1 / std::sqrt(len);
+		for (size_t d = 0; d < cols; ++d)
+			r[d] *= len;
+	}
+
+	return std::vector<float>(m.begin(), m.end());
+}
+
+static std::ofstream
+open_output(const std::filesystem::path &path, bool binary = false)
+{
+	std::ofstream out(path, binary ? std::ios::binary : std::ios::out);
+	if (!out)
+		throw std::runtime_error("Error opening file: " +
+		                         path.string());
+	return out;
+}
+
+static void
+write_floats(std::ofstream &out, const float *data, size_t n)
+{
+	out.write(reinterpret_cast<const char *>(data), n * sizeof(float));
+}
+
+/** Unique pronounceable word for each index */
+static std::string
+keyword_string(size_t i)
+{
+	static const char *syllables[] = { "ba", "ko", "mi", "tu", "re",
+		                           "sa", "lo", "ni", "ve", "da",
+		                           "pu", "ge", "ha", "zo", "fi",
+		                           "ru" };
+	constexpr size_t n_syl = sizeof(syllables) / sizeof(*syllables);
+
+	std::string res;
+	do {
+		res += syllables[i % n_syl];
+		i /= n_syl;
+	} while (i > 0);
+	return res;
+}
+
+static size_t
+random_count(size_t avg, std::mt19937 &rng)
+{
+	std::uniform_int_distribution<size_t> dist(1, 2 * avg - 1);
+	return dist(rng);
+}
+
+/**
+ * Writes the frames list and the feature matrix, fills in the cluster of
+ * each video.
+ */
+static void
+write_frames(const GeneratorOptions &opts,
+             const std::vector<float> &clusters,
+             std::vector<size_t> &video_clusters,
+             std::mt19937 &rng)
+{
+	namespace fs = std::filesystem;
+	const size_t dim = opts.dim;
+
+	auto list = open_output(fs::path(opts.out_dir) / "frames.dataset");
+	auto feats =
+	  open_output(fs::path(opts.out_dir) / "features.viretfromat", true);
+
+	// Header of the feature matrix (frames, row size, reserved)
+	uint32_t header[3] = { uint32_t(opts.frames),
+		               uint32_t(dim * sizeof(float)),
+		               0 };
+	feats.write(reinterpret_cast<const char *>(header), sizeof(header));
+
+	std::uniform_int_distribution<size_t> cluster_dist(
+	  0, opts.clusters - 1);
+	std::uniform_int_distribution<size_t> gap_dist(10, 150);
+
+	std::vector<float> shot_center(dim);
+	std::vector<float> shot_features;
+	std::vector<size_t> shot_frame_nums;
+	char filename[128];
+
+	video_clusters.clear();
+	for (size_t written = 0, video = 0; written < opts.frames; ++video) {
+		if (video >= MAX_VIDEOS)
+			throw std::runtime_error(
+			  "Too many videos, increase the shots per video");
+
+		video_clusters.push_back(cluster_dist(rng));
+		const float *center =
+		  clusters.data() + video_clusters.back() * dim;
+		size_t n_shots =
+		  std::min(random_count(opts.shots_per_video, rng),
+		           MAX_SHOTS_PER_VIDEO);
+
+		size_t frame_num = 0;
+		for (size_t shot = 0; shot < n_shots && written < opts.frames;
+		     ++shot) {
+			size_t n_frames =
+			  std::min(random_count(opts.frames_per_shot, rng),
+			           opts.frames - written);
+
+			scatter(
+			  center, SHOT_SPREAD, dim, shot_center.data(), rng);
+
+			shot_features.resize(n_frames * dim);
+			shot_frame_nums.clear();
+			size_t shot_begin = frame_num;
+			for (size_t f = 0; f < n_frames; ++f) {
+				frame_num += gap_dist(rng);
+				shot_frame_nums.push_back(frame_num);
+				scatter(shot_center.data(),
+				        FRAME_SPREAD,
+				        dim,
+				        shot_features.data() + f * dim,
+				        rng);
+			}
+			frame_num += gap_dist(rng);
+
+			// the same layout as the V3C1 keyframe lists
+			for (size_t num : shot_frame_nums) {
+				std::snprintf(
+				  filename,
+				  sizeof(filename),
+				  "%05zu/v%05zu_s%05zu(f%08zu-f%08zu)_"
+				  "f%08zu.jpg\n",
+				  video,
+				  video,
+				  shot,
+				  shot_begin,
+				  frame_num,
+				  num);
+				list << filename;
+			}
+			write_floats(
+			  feats, shot_features.data(), n_frames * dim);
+			written += n_frames;
+		}
+	}
+
+	if (!list || !feats)
+		throw std::runtime_error("Error writing the frames");
+}
+
+/**
+ * Writes the keyword vocabulary and the model matrices.
+ *
+ * The model embeds a keyword as
+ * `normalize(pca * (normalize(tanh(kw + bias)) - mean))`, with zero bias
+ * and mean, orthonormal `pca` rows and `kw = scale * pca^T * target` this
+ * is approximately the (unit-norm) `target`, which is chosen close to the
+ * cluster of a random video (so that each keyword has some matches).
+ */
+static void
+write_keywords(const GeneratorOptions &opts,
+               const std::vector<float> &clusters,
+               const std::vector<size_t> &video_clusters,
+               std::mt19937 &rng)
+{
+	namespace fs = std::filesystem;
+	const size_t dim = opts.dim, pre_dim = opts.pre_pca_dim;
+	const fs::path dir(opts.out_dir);
+
+	auto pca = random_orthonormal_rows(dim, pre_dim, rng);
+	std::vector<float> zeros(pre_dim, 0.0f);
+
+	auto bias = open_output(dir / "kw_bias.bin", true);
+	write_floats(bias, zeros.data(), pre_dim);
+	auto mean = open_output(dir / "kw_pca_mean.bin", true);
+	write_floats(mean, zeros.data(), pre_dim);
+	auto pca_out = open_output(dir / "kw_pca_mat.bin", true);
+	write_floats(pca_out, pca.data(), pca.size());
+
+	auto words = open_output(dir / "keywords.txt");
+	auto weights = open_output(dir / "kw_weights.bin", true);
+
+	std::uniform_int_distribution<size_t> video_dist(
+	  0, video_clusters.size() - 1);
+	std::vector<float> target(dim), row(pre_dim);
+	for (size_t kw = 0; kw < opts.keywords; ++kw) {
+		scatter(clusters.data() + video_clusters[video_dist(rng)] * dim,
+		        KEYWORD_SPREAD,
+		        dim,
+		        target.data(),
+		        rng);
+
+		std::fill(row.begin(), row.end(), 0.0f);
+		for (size_t i = 0; i < dim; ++i) {
+			const float *pca_row = pca.data() + i * pre_dim;
+			for (size_t d = 0; d < pre_dim; ++d)
+				row[d] +=
+				  KEYWORD_SCALE * target[i] * pca_row[d];
+		}
+
+		write_floats(weights, row.data(), pre_dim);
+		words << keyword_string(kw) << ':' << kw << '\n';
+	}
+
+	if (!bias || !mean || !pca_out || !words || !weights)
+		throw std::runtime_error("Error writing the keyword model");
+}
+
+static void
+write_config(const GeneratorOptions &opts)
+{
+	namespace fs = std::filesystem;
+	auto path = [&](const char *file) {
+		return (fs::path(opts.out_dir) / file).generic_string();
+	};
+
+	auto out = open_output(fs::path(opts.out_dir) / "config.json");
+	out << "{\n"
+	    << "  \"submitter_config\":{\n"
+	    << "    \"submit_to_VBS\": false,\n"
+	    << "    \"submit_rerank_URL\": \"\",\n"
+	    << "    \"submit_URL\": \"\",\n"
+	    << "    \"team_ID\": 0,\n"
+	    << "    \"member_ID\": 0,\n"
+	    << "    \"VBS_submit_archive_dir\": \"" << path("vbs-log")
+	    << "\",\n"
+	    << "    \"VBS_submit_archive_log_suffix\": \".json\",\n"
+	    << "    \"extra_verbose_log\": false,\n"
+	    << "    \"send_logs_to_server_period\": 10000,\n"
+	    << "    \"log_replay_timeout\": 1000,\n"
+	    << "    \"log_batch_window\": 0,\n"
+	    << "    \"log_gzip\": false,\n"
+	    << "    \"max_backlog_events\": 1000\n"
+	    << "  },\n\n"
+	    << "  \"max_frame_filename_len\": 64,\n"
+	    << "  \"filename_offsets\": {\n"
+	    << "    \"fr_filename_off\": 6,\n"
+	    << "    \"fr_filename_vid_ID_off\": 7,\n"
+	    << "    \"fr_filename_vid_ID_len\": 5,\n"
+	    << "    \"fr_filename_shot_ID_off\": 14,\n"
+	    << "    \"fr_filename_shot_ID_len\": 5,\n"
+	    << "    \"fr_filename_frame_num_off\": 42,\n"
+	    << "    \"fr_filename_frame_num_len\": 8\n"
+	    << "  },\n\n"
+	    << "  \"frames_list_file\": \"" << path("frames.dataset")
+	    << "\",\n"
+	    << "  \"frames_catalogue_file\": \"\",\n"
+	    << "  \"frames_path_prefix\": \"/thumbs/\",\n\n"
+	    << "  \"features_file_data_off\": 12,\n"
+	    << "  \"features_file\": \"" << path("features.viretfromat")
+	    << "\",\n"
+	    << "  \"features_dim\": " << opts.dim << ",\n\n"
+	    << "  \"pre_PCA_features_dim\": " << opts.pre_pca_dim << ",\n"
+	    << "  \"kw_bias_vec_file\": \"" << path("kw_bias.bin") << "\",\n"
+	    << "  \"kw_scores_mat_file\": \"" << path("kw_weights.bin")
+	    << "\",\n"
+	    << "  \"kw_PCA_mean_vec_file\": \"" << path("kw_pca_mean.bin")
+	    << "\",\n"
+	    << "  \"kw_PCA_mat_file\": \"" << path("kw_pca_mat.bin")
+	    << "\",\n"
+	    << "  \"kw_PCA_mat_dim\": " << opts.dim << ",\n\n"
+	    << "  \"kws_file\": \"" << path("keywords.txt") << "\",\n"
+	    << "  \"kw_bundle_file\": \"\",\n"
+	    << "  \"kw_precompute_projections\": false,\n\n"
+	    << "  \"display_page_size\": 128,\n"
+	    << "  \"topn_frames_per_video\": 12,\n"
+	    << "  \"topn_frames_per_shot\": 6,\n\n"
+	    << "  \"log_level\": 1,\n"
+	    << "  \"log_to_file\": false\n"
+	    << "}\n";
+
+	if (!out)
+		throw std::runtime_error("Error writing the config");
+}
+
+int
+main(int argc, char **argv)
+{
+	GeneratorOptions opts;
+
+	try {
+		for (int i = 1; i < argc; ++i) {
+			std::string arg = argv[i];
+			auto next = [&]() -> size_t {
+				if (i + 1 >= argc)
+					throw std::runtime_error(
+					  "Missing value of " + arg);
+				return std::stoul(argv[++i]);
+			};
+
+			if (arg == "--frames")
+				opts.frames = next();
+			else if (arg == "--dim")
+				opts.dim = next();
+			else if (arg == "--pre-pca-dim")
+				opts.pre_pca_dim = next();
+			else if (arg == "--keywords")
+				opts.keywords = next();
+			else if (arg == "--clusters")
+				opts.clusters = next();
+			else if (arg == "--shots-per-video")
+				opts.shots_per_video = next();
+			else if (arg == "--frames-per-shot")
+				opts.frames_per_shot = next();
+			else if (arg == "--seed")
+				opts.seed = next();
+			else if (arg.rfind("--", 0) == 0)
+				throw std::runtime_error("Unknown option " +
+				                         arg);
+			else
+				opts.out_dir = arg;
+		}
+
+		if (opts.out_dir.empty())
+			throw std::runtime_error("Missing output directory");
+		if (opts.frames == 0 || opts.dim == 0 || opts.clusters == 0 ||
+		    opts.shots_per_video == 0 || opts.frames_per_shot == 0)
+			throw std::runtime_error("Counts must be positive");
+		if (opts.keywords < 3)
+			throw std::runtime_error("At least 3 keywords needed");
+		if (opts.pre_pca_dim < opts.dim)
+			throw std::runtime_error(
+			  "Keyword model dimension must not be smaller than "
+			  "the feature dimension");
+	} catch (const std::exception &e) {
+		std::cerr << e.what() << "\nUsage: " << argv[0]
+		          << " [--frames count] [--dim dim] "
+		             "[--pre-pca-dim dim] [--keywords count] "
+		             "[--clusters count] [--shots-per-video avg] "
+		             "[--frames-per-shot avg] [--seed seed] "
+		             "<output directory>"
+		          << std::endl;
+		return 1;
+	}
+
+	try {
+		std::filesystem::create_directories(opts.out_dir);
+		std::mt19937 rng(opts.seed);
+
+		auto clusters =
+		  random_unit_vectors(opts.clusters, opts.dim, rng);
+
+		std::vector<size_t> video_clusters;
+		write_frames(opts, clusters, video_clusters, rng);
+		std::cout << "Written " << opts.frames << " frames in "
+		          << video_clusters.size() << " videos" << std::endl;
+
+		write_keywords(opts, clusters, video_clusters, rng);
+		std::cout << "Written " << opts.keywords << " keywords"
+		          << std::endl;
+
+		write_config(opts);
+	} catch (const std::exception &e) {
+		std::cerr << "Generation failed: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -43,21 +43,17 @@ exports.setTextQueries = function (state, q0, q1) {
 
 exports.switchScreenTo = function (state, screen, frames, targetFrame) {
   // Apply current likes
-  for (let i = 0; i < frames.length; ++i) {
+  for (let i = 0; i < frames.ids.length; ++i) {
     // If UI has it liked
-    if (state.likes.includes(frames[i].id)) {
-      frames[i].liked = true;
-    }
-
-    // If null image
-    if (frames[i].id == null) {
-      frames[i].src = "/images/no_img.jpg";
+    if (state.likes.includes(frames.ids[i])) {
+      frames.liked[i] = true;
     }
   }
 
   state.screen = {
     type: screen,
-    frames: frames,
+    ids: frames.ids,
+    liked: frames.liked,
   };
   
   state.frameContext.frameId = targetFrame;
@@ -88,10 +84,7 @@ exports.getUnlikes = function (state) {
 exports.resetLikes = function (state) {
   state.likes = [];
 
-  const frames = state.screen.frames;
-    for (let i = 0; i < frames.length; ++i) {
-      frames[i].liked = false;
-    }
+  state.screen.liked.fill(false);
 };
 
 exports.resetUnlikes = function (state) {
@@ -112,10 +105,10 @@ exports.likeFrame = function (state, frameId) {
   state.likes.push(frameId);
 
   // Walk all the frames and like it
-  const frames = state.screen.frames;
-  for (let i = 0; i < frames.length; ++i) {
-    if (frames[i].id == frameId) {
-      frames[i].liked = true;
+  const screen = state.screen;
+  for (let i = 0; i < screen.ids.length; ++i) {
+    if (screen.ids[i] == frameId) {
+      screen.liked[i] = true;
     }
   }
 
@@ -129,10 +122,10 @@ exports.unlikeFrame = function (state, frameId) {
     state.unlikes.push(frameId);
 
     // Walk all the frames and unlike it
-    const frames = state.screen.frames;
-    for (let i = 0; i < frames.length; ++i) {
-      if (frames[i].id == frameId) {
-        frames[i].liked = false;
+    const screen = state.screen;
+    for (let i = 0; i < screen.ids.length; ++i) {
+      if (screen.ids[i] == frameId) {
+        screen.liked[i] = false;
       }
     }
 
@@ -0,0 +1,63 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+"use strict";
+
+/*
+ * Search sessions of the core, one per Express session.
+ *
+ * The core keeps the dataset loaded only once and creates lightweight
+ * search contexts on demand; this keeps track of when each was last used so
+ * that abandoned ones can be destroyed.
+ */
+
+// Last use timestamp by the session ID
+const lastUsed = new Map();
+
+/** Returns the core session ID for the request, creating the session if needed. */
+exports.getId = function (req) {
+  const sessId = req.sessionID;
+
+  if (!lastUsed.has(sessId)) {
+    global.core.createSession(sessId);
+    global.logger.log("debug", "Created core session " + sessId);
+  }
+  lastUsed.set(sessId, Date.now());
+
+  return sessId;
+};
+
+/** Destroys the core session with the given ID. */
+exports.destroy = function (sessId) {
+  lastUsed.delete(sessId);
+  return global.core.destroySession(sessId);
+};
+
+/** Destroys all core sessions that were not used for `maxIdleMs` milliseconds. */
+exports.destroyIdle = function (maxIdleMs) {
+  const now = Date.now();
+
+  for (const [sessId, time] of lastUsed) {
+    if (now - time > maxIdleMs) {
+      this.destroy(sessId);
+      global.logger.log("debug", "Destroyed idle core session " + sessId);
+    }
+  }
+};
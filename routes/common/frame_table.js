@@ -0,0 +1,63 @@
+
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2020 František Mejzlík <frankmejzlik@gmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Veselý <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+"use strict";
+
+const crypto = require("crypto");
+
+/*
+ * Frame ID -> thumbnail path table for the compact displays of the core.
+ *
+ * The displays carry just the frame IDs and liked flags, the browser
+ * resolves the thumbnail paths from the filename table. The table is
+ * serialized once and served under a URL versioned by its hash, so the
+ * browser fetches it only once.
+ */
+
+// ID the core uses for the empty places of a display (e.g. empty SOM cells)
+const NULL_ID = 0xffffffff;
+
+let table = null;
+
+/** Returns the serialized table (`body`) and its ETag. */
+exports.getTable = function () {
+  if (table === null) {
+    const body = JSON.stringify({
+      pathPrefix: global.cfg.framesPathPrefix,
+      filenames: global.core.getFrameFilenames(),
+    });
+    const hash = crypto.createHash("sha1").update(body).digest("hex");
+    table = { body: body, etag: '"' + hash + '"', url: "/get_frame_filenames?v=" + hash };
+  }
+  return table;
+};
+
+/** Returns the versioned URL of the table for the client. */
+exports.getUrl = function () {
+  return this.getTable().url;
+};
+
+/** Converts a compact display of the core to the ID and liked arrays of the UI. */
+exports.toScreen = function (display) {
+  return {
+    ids: Array.from(display.ids, (id) => (id === NULL_ID ? null : id)),
+    liked: Array.from(display.liked, (l) => l !== 0),
+  };
+};
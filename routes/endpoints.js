@@ -24,8 +24,10 @@ const fs = require("fs");
 const path = require("path");
 
 const SessionState = require("./common/SessionState");
+const coreSessions = require("./common/core_sessions");
+const frameTable = require("./common/frame_table");
 
-exports.getFrameDetailData = function (req, res) {
+exports.getFrameDetailData = async function (req, res, next) {
   const sess = req.session;
 
   const frameId = Number(req.query.frameId);
@@ -33,28 +35,45 @@ exports.getFrameDetailData = function (req, res) {
   let frameData = {};
   // -------------------------------
   // Call the core
-  frameData = global.core.getDisplay(global.cfg.framesPathPrefix, "detail", null, frameId);
+  try {
+    const display = await global.core.getDisplayCompactAsync(
+      coreSessions.getId(req),
+      global.cfg.framesPathPrefix,
+      "detail",
+      null,
+      frameId
+    );
+    frameData = frameTable.toScreen(display);
+    frameData.page = display.page;
+  } catch (err) {
+    return next(err);
+  }
   // -------------------------------
 
   res.status(200).jsonp(frameData);
 };
 
-exports.getSomScreen = function (req, res) {
+exports.getSomScreen = async function (req, res, next) {
   const sess = req.session;
 
   let frameData = {};
 
-  if (!global.core.isSomReady()) {
+  if (!global.core.isSomReady(coreSessions.getId(req))) {
     res.status(200).jsonp({ viewData: null, error: { message: "SOM not yet ready." } });
     return;
   }
 
   // -------------------------------
   // Call the core
-  frameData = global.core.getDisplay(global.cfg.framesPathPrefix, "som");
+  try {
+    const display = await global.core.getDisplayCompactAsync(coreSessions.getId(req), global.cfg.framesPathPrefix, "som");
+    frameData = frameTable.toScreen(display);
+  } catch (err) {
+    return next(err);
+  }
   // -------------------------------
 
-  SessionState.switchScreenTo(sess.state, "som", frameData.frames, 0);
+  SessionState.switchScreenTo(sess.state, "som", frameData, 0);
 
   let viewData = {};
   viewData.somhunter = SessionState.getSomhunterUiState(sess.state);
@@ -62,7 +81,7 @@ exports.getSomScreen = function (req, res) {
   res.status(200).jsonp({ viewData: viewData });
 };
 
-exports.getTopScreen = function (req, res) {
+exports.getTopScreen = async function (req, res, next) {
   const sess = req.session;
 
   global.logger.log("info", req.query)
@@ -78,11 +97,21 @@ exports.getTopScreen = function (req, res) {
   if (req.query && req.query.frameId)
     frameId = Number(req.query.frameId);
 
-  let frames = [];
+  let frames = { ids: [], liked: [] };
   // -------------------------------
   // Call the core
-  const displayFrames = global.core.getDisplay(global.cfg.framesPathPrefix, type, pageId, frameId);
-  frames = displayFrames.frames;
+  try {
+    const display = await global.core.getDisplayCompactAsync(
+      coreSessions.getId(req),
+      global.cfg.framesPathPrefix,
+      type,
+      pageId,
+      frameId
+    );
+    frames = frameTable.toScreen(display);
+  } catch (err) {
+    return next(err);
+  }
   // -------------------------------
 
   SessionState.switchScreenTo(sess.state, type, frames, frameId);
@@ -93,7 +122,7 @@ exports.getTopScreen = function (req, res) {
   res.status(200).jsonp({ viewData: viewData });
 };
 
-exports.rescore = function (req, res) {
+exports.rescore = async function (req, res, next) {
   const sess = req.session;
 
   const body = req.body;
@@ -115,9 +144,14 @@ exports.rescore = function (req, res) {
 
   // -------------------------------
   // Call the core
-  global.core.addLikes(likes);
-  global.core.removeLikes(unlikes);
-  global.core.rescore(textQuery);
+  const sessId = coreSessions.getId(req);
+  try {
+    await global.core.addLikesAsync(sessId, likes);
+    await global.core.removeLikesAsync(sessId, unlikes);
+    await global.core.rescoreAsync(sessId, textQuery);
+  } catch (err) {
+    return next(err);
+  }
   // -------------------------------
 
   // Reset likes
@@ -127,7 +161,7 @@ exports.rescore = function (req, res) {
   res.status(200).jsonp({});
 };
 
-exports.submitFrame = function (req, res) {
+exports.submitFrame = async function (req, res, next) {
   const sess = req.session;
 
   const body = req.body;
@@ -135,12 +169,31 @@ exports.submitFrame = function (req, res) {
 
   // -------------------------------
   // Call the core
-  global.core.submitToServer(submittedFrameId);
+  try {
+    await global.core.submitToServerAsync(coreSessions.getId(req), submittedFrameId);
+  } catch (err) {
+    return next(err);
+  }
   // -------------------------------
 
   res.status(200).jsonp({});
 };
 
+exports.getFrameFilenames = function (req, res) {
+  const table = frameTable.getTable();
+
+  // The URL carries the hash of the table (see frameTable.getUrl)
+  res.set("Cache-Control", "public, max-age=31536000, immutable");
+  res.set("ETag", table.etag);
+  res.status(200).type("json").send(table.body);
+};
+
+exports.getStageStats = function (req, res) {
+  // Latency statistics of the core stages, `?reset=1` clears them
+  const stats = global.core.getStageStats(req.query.reset === "1");
+  res.status(200).type("json").send(stats);
+};
+
 exports.getAutocompleteResults = function (req, res) {
   const sess = req.session;
 
@@ -149,6 +202,7 @@ exports.getAutocompleteResults = function (req, res) {
   // -------------------------------
   // Call the core
   const acKeywords = global.core.autocompleteKeywords(
+    coreSessions.getId(req),
     global.cfg.framesPathPrefix,
     prefix,
     global.cfg.autocompleteResCount
@@ -158,12 +212,16 @@ exports.getAutocompleteResults = function (req, res) {
   res.status(200).jsonp(acKeywords);
 };
 
-exports.resetSearchSession = function (req, res) {
+exports.resetSearchSession = async function (req, res, next) {
   const sess = req.session;
 
   // -------------------------------
   // Call the core
-  global.core.resetAll();
+  try {
+    await global.core.resetAllAsync(coreSessions.getId(req));
+  } catch (err) {
+    return next(err);
+  }
   // -------------------------------
 
   SessionState.resetSearchSession(sess.state);
@@ -26,6 +26,8 @@ const path = require("path");
 
 const SessionState = require("./common/SessionState");
 const stateCheck = require("./common/state_checkers");
+const coreSessions = require("./common/core_sessions");
+const frameTable = require("./common/frame_table");
 
 /** Specific route settings. */
 const routeSettings = {
@@ -46,7 +48,7 @@ function postProcessReq(req, viewData) {
 /**
  * GET request handler
  */
-router.get("/", function (req, res, next) {
+router.get("/", async function (req, res, next) {
   const viewData = stateCheck.initRequest(req);
 
   global.logger.log("debug", "Route: " + routeSettings.slug);
@@ -58,15 +60,20 @@ router.get("/", function (req, res, next) {
   processReq(req, viewData);
   postProcessReq(req, viewData);
 
-  let frames = [];
+  let frames = { ids: [], liked: [] };
   // -------------------------------
   // Call the core
-  const displayFrames = global.core.getDisplay(global.cfg.framesPathPrefix, "topn", 0);
-  frames = displayFrames.frames;
+  try {
+    const display = await global.core.getDisplayCompactAsync(coreSessions.getId(req), global.cfg.framesPathPrefix, "topn", 0);
+    frames = frameTable.toScreen(display);
+  } catch (err) {
+    return next(err);
+  }
   // -------------------------------
 
   SessionState.switchScreenTo(sess.state, "topn", frames, 0);
   viewData.somhunter = SessionState.getSomhunterUiState(sess.state);
+  viewData.frameTableUrl = frameTable.getUrl();
 
   // Resolve and render dedicated template
   res.render(routeSettings.slug, viewData);